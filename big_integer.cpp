@@ -0,0 +1,353 @@
+#include "big_integer.h"
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+BigInteger::BigInteger() : negative(false) {}
+
+BigInteger::BigInteger(long long x) : negative(x < 0) {
+	// Through unsigned arithmetic, so that the minimal long long has a magnitude too
+	unsigned long long magnitude = (x < 0 ? 0ULL - static_cast<unsigned long long>(x) : static_cast<unsigned long long>(x));
+	while (magnitude > 0) {
+		limbs.push_back(static_cast<uint32_t>(magnitude));
+		magnitude >>= 32;
+	}
+}
+
+BigInteger::BigInteger(bool negative, vector<uint32_t> limbs) : negative(negative), limbs(move(limbs)) {
+	Trim();
+}
+
+bool BigInteger::IsZero() const {
+	return limbs.empty();
+}
+
+int BigInteger::Sign() const {
+	return (limbs.empty() ? 0 : (negative ? -1 : 1));
+}
+
+bool BigInteger::FitsLongLong() const {
+	if (limbs.size() <= 1)
+		return true;
+	if (limbs.size() > 2)
+		return false;
+
+	const unsigned long long magnitude = (static_cast<unsigned long long>(limbs[1]) << 32) | limbs[0];
+	return magnitude <= (negative ? 1ULL << 63 : (1ULL << 63) - 1);
+}
+
+long long BigInteger::ToLongLong() const {
+	unsigned long long magnitude = 0;
+	for (size_t i = min<size_t>(limbs.size(), 2); i-- > 0;)
+		magnitude = (magnitude << 32) | limbs[i];
+
+	return static_cast<long long>(negative ? 0ULL - magnitude : magnitude);
+}
+
+const vector<uint32_t>& BigInteger::Limbs() const {
+	return limbs;
+}
+
+double BigInteger::ToDouble() const {
+	double result = 0;
+	for (size_t i = limbs.size(); i-- > 0;)
+		result = result * 4294967296.0 + limbs[i];
+
+	return (negative ? -result : result);
+}
+
+string BigInteger::ToString() const {
+	if (limbs.empty())
+		return "0";
+
+	// Peel off nine decimal digits at a time
+	vector<uint32_t> magnitude = limbs;
+	string digits;
+	while (!magnitude.empty()) {
+		unsigned long long remainder = 0;
+		for (size_t i = magnitude.size(); i-- > 0;) {
+			const unsigned long long current = (remainder << 32) | magnitude[i];
+			magnitude[i] = static_cast<uint32_t>(current / 1000000000);
+			remainder = current % 1000000000;
+		}
+		while (!magnitude.empty() && magnitude.back() == 0)
+			magnitude.pop_back();
+
+		for (int k = 0; k < 9 && (remainder > 0 || !magnitude.empty()); ++k) {
+			digits.push_back(static_cast<char>('0' + remainder % 10));
+			remainder /= 10;
+		}
+	}
+	if (negative)
+		digits.push_back('-');
+
+	reverse(digits.begin(), digits.end());
+	return digits;
+}
+
+BigInteger BigInteger::operator+() const {
+	return *this;
+}
+
+BigInteger BigInteger::operator-() const {
+	BigInteger result = *this;
+	result.negative = !negative && !limbs.empty();
+	return result;
+}
+
+BigInteger operator+(const BigInteger& first, const BigInteger& second) {
+	return BigInteger::AddSigned(first, second, false);
+}
+
+BigInteger operator-(const BigInteger& first, const BigInteger& second) {
+	return BigInteger::AddSigned(first, second, true);
+}
+
+BigInteger operator*(const BigInteger& first, const BigInteger& second) {
+	BigInteger result;
+	result.limbs = BigInteger::MultiplyMagnitudes(first.limbs, second.limbs);
+	result.negative = first.negative != second.negative;
+	result.Trim();
+	return result;
+}
+
+BigInteger operator/(const BigInteger& first, const BigInteger& second) {
+	BigInteger quotient, remainder;
+	BigInteger::DivMod(first, second, quotient, remainder);
+	return quotient;
+}
+
+BigInteger operator%(const BigInteger& first, const BigInteger& second) {
+	BigInteger quotient, remainder;
+	BigInteger::DivMod(first, second, quotient, remainder);
+	return remainder;
+}
+
+BigInteger& BigInteger::operator+=(const BigInteger& second) {
+	return *this = *this + second;
+}
+
+BigInteger& BigInteger::operator-=(const BigInteger& second) {
+	return *this = *this - second;
+}
+
+BigInteger& BigInteger::operator*=(const BigInteger& second) {
+	return *this = *this * second;
+}
+
+BigInteger& BigInteger::operator/=(const BigInteger& second) {
+	return *this = *this / second;
+}
+
+BigInteger& BigInteger::operator%=(const BigInteger& second) {
+	return *this = *this % second;
+}
+
+bool operator==(const BigInteger& first, const BigInteger& second) {
+	return first.negative == second.negative && first.limbs == second.limbs;
+}
+
+bool operator!=(const BigInteger& first, const BigInteger& second) {
+	return !(first == second);
+}
+
+bool operator<(const BigInteger& first, const BigInteger& second) {
+	if (first.negative != second.negative)
+		return first.negative;
+
+	const int compare = BigInteger::CompareMagnitudes(first.limbs, second.limbs);
+	return (first.negative ? compare > 0 : compare < 0);
+}
+
+bool operator<=(const BigInteger& first, const BigInteger& second) {
+	return !(second < first);
+}
+
+bool operator>(const BigInteger& first, const BigInteger& second) {
+	return second < first;
+}
+
+bool operator>=(const BigInteger& first, const BigInteger& second) {
+	return !(first < second);
+}
+
+std::ostream& operator<<(std::ostream& out, const BigInteger& x) {
+	return out << x.ToString();
+}
+
+BigInteger Gcd(BigInteger first, BigInteger second) {
+	first.negative = second.negative = false;
+	while (!second.IsZero()) {
+		first %= second;
+		swap(first, second);
+	}
+
+	return first;
+}
+
+void BigInteger::DivMod(const BigInteger& first, const BigInteger& second, BigInteger& quotient, BigInteger& remainder) {
+	if (second.IsZero())
+		throw std::out_of_range("Divide by zero exception");
+
+	DivModMagnitudes(first.limbs, second.limbs, quotient.limbs, remainder.limbs);
+	quotient.negative = first.negative != second.negative;
+	remainder.negative = first.negative;
+	quotient.Trim();
+	remainder.Trim();
+}
+
+void BigInteger::Trim() {
+	while (!limbs.empty() && limbs.back() == 0)
+		limbs.pop_back();
+	if (limbs.empty())
+		negative = false;
+}
+
+int BigInteger::CompareMagnitudes(const vector<uint32_t>& first, const vector<uint32_t>& second) {
+	if (first.size() != second.size())
+		return (first.size() < second.size() ? -1 : 1);
+
+	for (size_t i = first.size(); i-- > 0;)
+		if (first[i] != second[i])
+			return (first[i] < second[i] ? -1 : 1);
+
+	return 0;
+}
+
+vector<uint32_t> BigInteger::AddMagnitudes(const vector<uint32_t>& first, const vector<uint32_t>& second) {
+	const vector<uint32_t>& longer = (first.size() >= second.size() ? first : second);
+	const vector<uint32_t>& shorter = (first.size() >= second.size() ? second : first);
+
+	vector<uint32_t> result(longer.size() + 1);
+	unsigned long long carry = 0;
+	for (size_t i = 0; i < longer.size(); ++i) {
+		carry += static_cast<unsigned long long>(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+		result[i] = static_cast<uint32_t>(carry);
+		carry >>= 32;
+	}
+	result.back() = static_cast<uint32_t>(carry);
+
+	return result;
+}
+
+vector<uint32_t> BigInteger::SubtractMagnitudes(const vector<uint32_t>& first, const vector<uint32_t>& second) {
+	vector<uint32_t> result(first.size());
+	long long borrow = 0;
+	for (size_t i = 0; i < first.size(); ++i) {
+		long long current = static_cast<long long>(first[i]) - (i < second.size() ? second[i] : 0) - borrow;
+		borrow = (current < 0);
+		result[i] = static_cast<uint32_t>(current + (borrow << 32));
+	}
+
+	return result;
+}
+
+vector<uint32_t> BigInteger::MultiplyMagnitudes(const vector<uint32_t>& first, const vector<uint32_t>& second) {
+	if (first.empty() || second.empty())
+		return {};
+
+	vector<uint32_t> result(first.size() + second.size());
+	for (size_t i = 0; i < first.size(); ++i) {
+		unsigned long long carry = 0;
+		for (size_t j = 0; j < second.size(); ++j) {
+			carry += static_cast<unsigned long long>(first[i]) * second[j] + result[i + j];
+			result[i + j] = static_cast<uint32_t>(carry);
+			carry >>= 32;
+		}
+		result[i + second.size()] = static_cast<uint32_t>(carry);
+	}
+
+	return result;
+}
+
+// Knuth's algorithm D: the divisor is shifted so that its top limb has the high bit set, then every
+// quotient limb estimated from the top two limbs of the remainder is off by at most two.
+void BigInteger::DivModMagnitudes(const vector<uint32_t>& first, const vector<uint32_t>& second, vector<uint32_t>& quotient, vector<uint32_t>& remainder) {
+	if (CompareMagnitudes(first, second) < 0) {
+		quotient.clear();
+		remainder = first;
+		return;
+	}
+
+	const size_t n = second.size(), m = first.size() - n;
+	if (n == 1) {
+		quotient.assign(first.size(), 0);
+		unsigned long long current = 0;
+		for (size_t i = first.size(); i-- > 0;) {
+			current = (current << 32) | first[i];
+			quotient[i] = static_cast<uint32_t>(current / second[0]);
+			current %= second[0];
+		}
+		remainder.assign(1, static_cast<uint32_t>(current));
+		return;
+	}
+
+	const int shift = __builtin_clz(second.back());
+	vector<uint32_t> v(n), u(first.size() + 1);
+	for (size_t i = n; i-- > 0;)
+		v[i] = (second[i] << shift) | (shift && i ? static_cast<uint32_t>(static_cast<unsigned long long>(second[i - 1]) >> (32 - shift)) : 0);
+	u[first.size()] = (shift ? static_cast<uint32_t>(static_cast<unsigned long long>(first.back()) >> (32 - shift)) : 0);
+	for (size_t i = first.size(); i-- > 0;)
+		u[i] = (first[i] << shift) | (shift && i ? static_cast<uint32_t>(static_cast<unsigned long long>(first[i - 1]) >> (32 - shift)) : 0);
+
+	const unsigned long long base = 1ULL << 32;
+	quotient.assign(m + 1, 0);
+	for (size_t j = m + 1; j-- > 0;) {
+		const unsigned long long top = (static_cast<unsigned long long>(u[j + n]) << 32) | u[j + n - 1];
+		unsigned long long qhat = top / v[n - 1], rhat = top % v[n - 1];
+		while (qhat >= base || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+			--qhat;
+			rhat += v[n - 1];
+			if (rhat >= base)
+				break;
+		}
+
+		long long borrow = 0, current;
+		for (size_t i = 0; i < n; ++i) {
+			const unsigned long long product = qhat * v[i];
+			current = static_cast<long long>(u[i + j]) - borrow - static_cast<long long>(product & 0xFFFFFFFFULL);
+			u[i + j] = static_cast<uint32_t>(current);
+			borrow = static_cast<long long>(product >> 32) - (current >> 32);
+		}
+		current = static_cast<long long>(u[j + n]) - borrow;
+		u[j + n] = static_cast<uint32_t>(current);
+
+		quotient[j] = static_cast<uint32_t>(qhat);
+		if (current < 0) {
+			// The estimate was one too large, add the divisor back
+			--quotient[j];
+			unsigned long long carry = 0;
+			for (size_t i = 0; i < n; ++i) {
+				carry += static_cast<unsigned long long>(u[i + j]) + v[i];
+				u[i + j] = static_cast<uint32_t>(carry);
+				carry >>= 32;
+			}
+			u[j + n] += static_cast<uint32_t>(carry);
+		}
+	}
+
+	remainder.assign(n, 0);
+	for (size_t i = 0; i < n; ++i)
+		remainder[i] = (u[i] >> shift) | (shift ? static_cast<uint32_t>(static_cast<unsigned long long>(u[i + 1]) << (32 - shift)) : 0);
+}
+
+BigInteger BigInteger::AddSigned(const BigInteger& first, const BigInteger& second, bool negateSecond) {
+	const bool secondNegative = (second.negative != negateSecond) && !second.IsZero();
+
+	BigInteger result;
+	if (first.negative == secondNegative) {
+		result.limbs = AddMagnitudes(first.limbs, second.limbs);
+		result.negative = first.negative;
+	}
+	else if (CompareMagnitudes(first.limbs, second.limbs) >= 0) {
+		result.limbs = SubtractMagnitudes(first.limbs, second.limbs);
+		result.negative = first.negative;
+	}
+	else {
+		result.limbs = SubtractMagnitudes(second.limbs, first.limbs);
+		result.negative = secondNegative;
+	}
+	result.Trim();
+
+	return result;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Arbitrary precision integer: sign and magnitude in base 2^32 limbs, least significant first.
+// Division truncates towards zero like the built-in types.
+class BigInteger {
+public:
+    BigInteger();
+    BigInteger(long long x);
+    // Magnitude in base 2^32, least significant limb first
+    BigInteger(bool negative, std::vector<uint32_t> limbs);
+
+    bool IsZero() const;
+    int Sign() const;
+    const std::vector<uint32_t>& Limbs() const;
+
+    bool FitsLongLong() const;
+    // Only meaningful when FitsLongLong()
+    long long ToLongLong() const;
+    double ToDouble() const;
+    std::string ToString() const;
+
+    BigInteger operator+() const;
+    BigInteger operator-() const;
+
+    friend BigInteger operator+(const BigInteger& first, const BigInteger& second);
+    friend BigInteger operator-(const BigInteger& first, const BigInteger& second);
+    friend BigInteger operator*(const BigInteger& first, const BigInteger& second);
+    friend BigInteger operator/(const BigInteger& first, const BigInteger& second);
+    friend BigInteger operator%(const BigInteger& first, const BigInteger& second);
+
+    BigInteger& operator+=(const BigInteger& second);
+    BigInteger& operator-=(const BigInteger& second);
+    BigInteger& operator*=(const BigInteger& second);
+    BigInteger& operator/=(const BigInteger& second);
+    BigInteger& operator%=(const BigInteger& second);
+
+    friend bool operator==(const BigInteger& first, const BigInteger& second);
+    friend bool operator!=(const BigInteger& first, const BigInteger& second);
+    friend bool operator<(const BigInteger& first, const BigInteger& second);
+    friend bool operator<=(const BigInteger& first, const BigInteger& second);
+    friend bool operator>(const BigInteger& first, const BigInteger& second);
+    friend bool operator>=(const BigInteger& first, const BigInteger& second);
+
+    friend std::ostream& operator<<(std::ostream& out, const BigInteger& x);
+
+    // Non-negative, Gcd(0, 0) = 0
+    friend BigInteger Gcd(BigInteger first, BigInteger second);
+
+    // Quotient and remainder in one pass
+    static void DivMod(const BigInteger& first, const BigInteger& second, BigInteger& quotient, BigInteger& remainder);
+
+private:
+    bool negative;
+    std::vector<uint32_t> limbs;
+
+    void Trim();
+
+    static int CompareMagnitudes(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second);
+    static std::vector<uint32_t> AddMagnitudes(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second);
+    // first >= second
+    static std::vector<uint32_t> SubtractMagnitudes(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second);
+    static std::vector<uint32_t> MultiplyMagnitudes(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second);
+    static void DivModMagnitudes(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second, std::vector<uint32_t>& quotient, std::vector<uint32_t>& remainder);
+    static BigInteger AddSigned(const BigInteger& first, const BigInteger& second, bool negateSecond);
+};
@@ -0,0 +1,198 @@
+#include "binary_format.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const char BinaryMagic[4] = { 'A', 'L', 'G', 'B' };
+static const uint16_t BinaryByteOrder = 0x0102;
+
+BinaryHeader MakeBinaryHeader(BinaryKind kind, BinaryElement element, uint16_t elementSize, uint64_t height, uint64_t width, uint64_t modulus, uint64_t payloadSize) {
+	BinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BinaryMagic, sizeof(BinaryMagic));
+	header.version = BinaryFormatVersion;
+	header.byteOrder = BinaryByteOrder;
+	header.kind = kind;
+	header.element = element;
+	header.elementSize = elementSize;
+	header.height = height;
+	header.width = width;
+	header.modulus = modulus;
+	header.payloadSize = payloadSize;
+	return header;
+}
+
+void CheckBinaryHeader(const BinaryHeader& header, BinaryKind kind, BinaryElement element, uint16_t elementSize, uint64_t modulus) {
+	if (memcmp(header.magic, BinaryMagic, sizeof(BinaryMagic)) != 0)
+		throw runtime_error("not a binary algebra file");
+	if (header.byteOrder != BinaryByteOrder)
+		throw runtime_error("binary file was written with the other byte order");
+	if (header.version == 0 || header.version > BinaryFormatVersion)
+		throw runtime_error("binary format version " + to_string(header.version) + " is not supported");
+	if (header.kind != kind)
+		throw runtime_error("binary file holds another kind of object");
+	if (header.element != element || header.elementSize != elementSize)
+		throw runtime_error("binary file holds another element type");
+	if (header.modulus != modulus)
+		throw runtime_error("binary file holds residues of another modulus");
+}
+
+uint64_t CheckBinaryPayload(const BinaryHeader& header, bool raw, uint64_t recordSize, uint64_t available) {
+	if (header.width != 0 && header.height > UINT64_MAX / header.width)
+		throw runtime_error("binary header dimensions overflow");
+
+	// Rational payloads written to a stream that cannot seek back have no size, the bytes left bound them instead
+	const uint64_t count = header.height * header.width;
+	const uint64_t payloadSize = (raw || header.payloadSize != 0 ? header.payloadSize : available);
+	if (count > payloadSize / recordSize || (raw && count * recordSize != payloadSize))
+		throw runtime_error("binary payload size does not match the header dimensions");
+	if (payloadSize > available)
+		throw runtime_error("binary payload is truncated");
+	if (count > SIZE_MAX)
+		throw runtime_error("binary payload does not fit in memory");
+
+	return count;
+}
+
+uint64_t BinaryBytesLeft(istream& in) {
+	const streampos position = in.tellg();
+	if (position == streampos(-1))
+		return UINT64_MAX;
+
+	in.seekg(0, ios::end);
+	const streampos end = in.tellg();
+	in.seekg(position);
+	if (end == streampos(-1) || !in) {
+		in.clear();
+		in.seekg(position);
+		return UINT64_MAX;
+	}
+	return static_cast<uint64_t>(end - position);
+}
+
+// Inline values are the pair itself. Otherwise the denominator field is 0, the numerator field the number
+// of 8 byte words that follow, and then numerator and denominator as signed limb count and padded limbs.
+static void WriteBigInteger(ostream& out, const BigInteger& x) {
+	const int64_t count = static_cast<int64_t>(x.Limbs().size()) * (x.Sign() < 0 ? -1 : 1);
+	vector<uint32_t> limbs = x.Limbs();
+	limbs.resize((limbs.size() + 1) / 2 * 2, 0);
+	out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	out.write(reinterpret_cast<const char*>(limbs.data()), static_cast<streamsize>(limbs.size() * sizeof(uint32_t)));
+}
+
+static BigInteger ReadBigInteger(istream& in) {
+	int64_t count;
+	in.read(reinterpret_cast<char*>(&count), sizeof(count));
+	const uint64_t size = static_cast<uint64_t>(count < 0 ? -count : count);
+	if (!in || size > (1ULL << 32))
+		throw runtime_error("binary payload is truncated");
+
+	vector<uint32_t> limbs((size + 1) / 2 * 2);
+	in.read(reinterpret_cast<char*>(limbs.data()), static_cast<streamsize>(limbs.size() * sizeof(uint32_t)));
+	limbs.resize(size);
+	return BigInteger(count < 0, move(limbs));
+}
+
+void WriteRational(ostream& out, const Rational& x) {
+	const BigInteger a = x.Numerator(), b = x.Denominator();
+	if (a.FitsLongLong() && b.FitsLongLong()) {
+		const int64_t record[2] = { a.ToLongLong(), b.ToLongLong() };
+		out.write(reinterpret_cast<const char*>(record), sizeof(record));
+		return;
+	}
+
+	const int64_t record[2] = { static_cast<int64_t>(2 + (a.Limbs().size() + 1) / 2 + (b.Limbs().size() + 1) / 2), 0 };
+	out.write(reinterpret_cast<const char*>(record), sizeof(record));
+	WriteBigInteger(out, a);
+	WriteBigInteger(out, b);
+}
+
+Rational ReadRational(istream& in) {
+	int64_t record[2];
+	in.read(reinterpret_cast<char*>(record), sizeof(record));
+	if (!in)
+		throw runtime_error("binary payload is truncated");
+	if (record[1] != 0)
+		return Rational(record[0], record[1]);
+
+	const BigInteger a = ReadBigInteger(in);
+	const BigInteger b = ReadBigInteger(in);
+	if (!in)
+		throw runtime_error("binary payload is truncated");
+	return Rational(a, b);
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const string& path) : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw runtime_error("cannot open " + path);
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		throw runtime_error("cannot read the size of " + path);
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	if (size == 0)
+		return;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		throw runtime_error("cannot map " + path);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const string& path) : data(nullptr), size(0) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw runtime_error("cannot open " + path);
+
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		throw runtime_error("cannot read the size of " + path);
+	}
+	size = static_cast<size_t>(status.st_size);
+
+	if (size > 0) {
+		void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (address == MAP_FAILED) {
+			close(fd);
+			throw runtime_error("cannot map " + path);
+		}
+		data = static_cast<const unsigned char*>(address);
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if (data)
+		munmap(const_cast<unsigned char*>(data), size);
+}
+#endif
@@ -0,0 +1,421 @@
+#pragma once
+
+#include "gemm.h"
+#include "linal.h"
+#include "matrix.h"
+#include "mod_int.h"
+#include "poly.h"
+#include "rational.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Files start with a 64 byte header followed by the payload, so the payload of a mapped file is aligned
+// for every element type. Fixed-size elements are stored as raw memory in the byte order of the writer,
+// which the header records; readers reject files of the other byte order instead of swapping.
+// Rational elements are records of two int64, or of the limbs of two BigInteger for large values.
+
+constexpr uint16_t BinaryFormatVersion = 1;
+
+enum class BinaryKind : uint8_t
+{
+	Matrix = 1,
+	Poly = 2,
+	Basis = 3,
+	Rational = 4
+};
+
+enum class BinaryElement : uint8_t
+{
+	Int8 = 1, Int16, Int32, Int64,
+	UInt8, UInt16, UInt32, UInt64,
+	Float, Double,
+	Rational,
+	ModInt
+};
+
+struct BinaryHeader {
+	char magic[4];
+	uint16_t version;
+	uint16_t byteOrder;   // 0x0102 as stored by the writer
+	BinaryKind kind;
+	BinaryElement element;
+	uint16_t elementSize;
+	uint32_t reserved;
+	uint64_t height;      // Matrix: rows, Poly: coefficients, Basis: dimension, Rational: 1
+	uint64_t width;       // Matrix: columns, Basis: vectors, otherwise 1
+	uint64_t modulus;     // ModInt only
+	uint64_t payloadSize; // bytes after the header
+	uint8_t padding[16];
+};
+static_assert(sizeof(BinaryHeader) == 64, "BinaryHeader must keep the payload 64 byte aligned");
+
+BinaryHeader MakeBinaryHeader(BinaryKind kind, BinaryElement element, uint16_t elementSize, uint64_t height, uint64_t width, uint64_t modulus, uint64_t payloadSize);
+// Throws std::runtime_error naming the first field that does not match
+void CheckBinaryHeader(const BinaryHeader& header, BinaryKind kind, BinaryElement element, uint16_t elementSize, uint64_t modulus);
+// Number of elements height * width of a checked header, after checking it against the payload without overflow:
+// raw elements must fill payloadSize exactly, other records take recordSize bytes at least. available is the
+// number of bytes actually present after the header, UINT64_MAX if unknown. Throws std::runtime_error on mismatch.
+uint64_t CheckBinaryPayload(const BinaryHeader& header, bool raw, uint64_t recordSize, uint64_t available);
+// Bytes between the read position and the end of the stream, UINT64_MAX if the stream cannot seek
+uint64_t BinaryBytesLeft(std::istream& in);
+
+// Inline records, numerator and denominator as int64, are the shortest
+constexpr uint64_t BinaryRationalMinRecordSize = 2 * sizeof(int64_t);
+
+void WriteRational(std::ostream& out, const Rational& x);
+Rational ReadRational(std::istream& in);
+
+template<typename T, typename = void>
+struct BinaryElementTraits {
+	static constexpr bool supported = false;
+};
+
+template<typename T>
+struct BinaryElementTraits<T, std::enable_if_t<std::is_integral<T>::value || std::is_floating_point<T>::value>> {
+	static constexpr bool supported = true;
+	static constexpr bool raw = true;
+	static constexpr BinaryElement tag = (std::is_floating_point<T>::value ? (sizeof(T) == 4 ? BinaryElement::Float : BinaryElement::Double)
+		: static_cast<BinaryElement>((std::is_signed<T>::value ? 1 : 5) + (sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3)));
+	static uint64_t Modulus() {
+		return 0;
+	}
+};
+
+// Montgomery form depends on the modulus only, so the raw values can be mapped as they are
+template<uint64_t P>
+struct BinaryElementTraits<ModInt<P>> {
+	static constexpr bool supported = true;
+	static constexpr bool raw = true;
+	static constexpr BinaryElement tag = BinaryElement::ModInt;
+	static uint64_t Modulus() {
+		return ModInt<P>::Modulus();
+	}
+};
+
+template<>
+struct BinaryElementTraits<Rational> {
+	static constexpr bool supported = true;
+	static constexpr bool raw = false;
+	static constexpr BinaryElement tag = BinaryElement::Rational;
+	static uint64_t Modulus() {
+		return 0;
+	}
+};
+
+template<typename T>
+void WriteBinaryElements(std::ostream& out, const T* elements, size_t count) {
+	static_assert(BinaryElementTraits<T>::supported, "element type has no binary format");
+
+	if constexpr (BinaryElementTraits<T>::raw) {
+		out.write(reinterpret_cast<const char*>(elements), static_cast<std::streamsize>(count * sizeof(T)));
+	}
+	else {
+		for (size_t i = 0; i < count; ++i) {
+			WriteRational(out, elements[i]);
+		}
+	}
+}
+
+template<typename T>
+void ReadBinaryElements(std::istream& in, T* elements, size_t count) {
+	if constexpr (BinaryElementTraits<T>::raw) {
+		in.read(reinterpret_cast<char*>(elements), static_cast<std::streamsize>(count * sizeof(T)));
+	}
+	else {
+		for (size_t i = 0; i < count; ++i) {
+			elements[i] = ReadRational(in);
+		}
+	}
+	if (!in) {
+		throw std::runtime_error("binary payload is truncated");
+	}
+}
+
+// Reads the elements a checked header announces into allocate(count). The target is allocated once the payload is
+// known to be there: right away when the stream can tell how many bytes are left, and otherwise after reading
+// chunks that grow with the data, so a corrupt header cannot force a huge allocation.
+template<typename T, typename Allocate>
+void ReadBinaryPayload(std::istream& in, const BinaryHeader& header, Allocate allocate) {
+	using Traits = BinaryElementTraits<T>;
+	const uint64_t available = BinaryBytesLeft(in);
+	const uint64_t count = CheckBinaryPayload(header, Traits::raw, (Traits::raw ? sizeof(T) : BinaryRationalMinRecordSize), available);
+	if (available != UINT64_MAX) {
+		ReadBinaryElements(in, allocate(static_cast<size_t>(count)), static_cast<size_t>(count));
+		return;
+	}
+
+	std::vector<T> elements;
+	while (elements.size() < count) {
+		const size_t size = elements.size(), step = static_cast<size_t>(std::min<uint64_t>(count - size, std::max<size_t>(size, (1 << 16) / sizeof(T) + 1)));
+		elements.resize(size + step);
+		ReadBinaryElements(in, elements.data() + size, step);
+	}
+	std::move(elements.begin(), elements.end(), allocate(static_cast<size_t>(count)));
+}
+
+// Writes header and payload. The payload size of Rational data is only known afterwards, so it is patched in
+// when the stream is seekable and left as 0 otherwise (readers then trust the element records).
+template<typename T>
+void WriteBinary(std::ostream& out, BinaryKind kind, uint64_t height, uint64_t width, const T* elements, size_t count) {
+	using Traits = BinaryElementTraits<T>;
+	static_assert(Traits::supported, "element type has no binary format");
+
+	const uint64_t payloadSize = (Traits::raw ? count * sizeof(T) : 0);
+	BinaryHeader header = MakeBinaryHeader(kind, Traits::tag, sizeof(T), height, width, Traits::Modulus(), payloadSize);
+	const auto start = out.tellp();
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	WriteBinaryElements(out, elements, count);
+
+	if (!Traits::raw && start != std::streampos(-1)) {
+		const auto end = out.tellp();
+		header.payloadSize = static_cast<uint64_t>(end - start) - sizeof(header);
+		out.seekp(start);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.seekp(end);
+	}
+	if (!out) {
+		throw std::runtime_error("binary write failed");
+	}
+}
+
+template<typename T>
+BinaryHeader ReadBinaryHeader(std::istream& in, BinaryKind kind) {
+	BinaryHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		throw std::runtime_error("binary header is truncated");
+	}
+	CheckBinaryHeader(header, kind, BinaryElementTraits<T>::tag, sizeof(T), BinaryElementTraits<T>::Modulus());
+	return header;
+}
+
+template<typename T>
+void WriteBinary(std::ostream& out, const Matrix<T>& m) {
+	WriteBinary(out, BinaryKind::Matrix, m.Height(), m.Width(), m.GetData().data(), m.GetData().size());
+}
+
+template<typename T>
+void WriteBinary(std::ostream& out, const Poly<T>& p) {
+	const std::vector<T> coefficients = p.Coefficients();
+	WriteBinary(out, BinaryKind::Poly, coefficients.size(), 1, coefficients.data(), coefficients.size());
+}
+
+// Vectors one after another, so the payload is the transpose of BasisToMatrix
+template<typename T>
+void WriteBinary(std::ostream& out, const Basis<T>& basis) {
+	const size_t dimension = (basis.empty() ? 0 : basis[0].Height());
+	std::vector<T> elements;
+	elements.reserve(dimension * basis.size());
+	for (const auto& v : basis) {
+		for (size_t i = 0; i < dimension; ++i) {
+			elements.push_back(v[i][0]);
+		}
+	}
+	WriteBinary(out, BinaryKind::Basis, dimension, basis.size(), elements.data(), elements.size());
+}
+
+inline void WriteBinary(std::ostream& out, const Rational& x) {
+	WriteBinary(out, BinaryKind::Rational, 1, 1, &x, 1);
+}
+
+template<typename T>
+Matrix<T> ReadBinaryMatrix(std::istream& in) {
+	const BinaryHeader header = ReadBinaryHeader<T>(in, BinaryKind::Matrix);
+	Matrix<T> result;
+	ReadBinaryPayload<T>(in, header, [&](size_t) {
+		result = Matrix<T>(header.height, header.width);
+		return result.GetData().data();
+	});
+	return result;
+}
+
+template<typename T>
+Poly<T> ReadBinaryPoly(std::istream& in) {
+	const BinaryHeader header = ReadBinaryHeader<T>(in, BinaryKind::Poly);
+	std::vector<T> coefficients;
+	ReadBinaryPayload<T>(in, header, [&](size_t count) {
+		coefficients.resize(count);
+		return coefficients.data();
+	});
+	return Poly<T>(std::move(coefficients));
+}
+
+template<typename T>
+Basis<T> ReadBinaryBasis(std::istream& in) {
+	const BinaryHeader header = ReadBinaryHeader<T>(in, BinaryKind::Basis);
+	std::vector<T> elements;
+	ReadBinaryPayload<T>(in, header, [&](size_t count) {
+		elements.resize(count);
+		return elements.data();
+	});
+
+	Basis<T> result(header.width, Matrix<T>(header.height, 1));
+	for (size_t k = 0; k < header.width; ++k) {
+		for (size_t i = 0; i < header.height; ++i) {
+			result[k][i][0] = elements[k * header.height + i];
+		}
+	}
+	return result;
+}
+
+inline Rational ReadBinaryRational(std::istream& in) {
+	const BinaryHeader header = ReadBinaryHeader<Rational>(in, BinaryKind::Rational);
+	Rational result;
+	ReadBinaryPayload<Rational>(in, header, [&](size_t) {
+		return &result;
+	});
+	return result;
+}
+
+template<typename X>
+void SaveBinary(const std::string& path, const X& x) {
+	std::ofstream out(path, std::ios::binary);
+	if (!out) {
+		throw std::runtime_error("cannot open " + path + " for writing");
+	}
+	WriteBinary(out, x);
+}
+
+inline std::ifstream OpenBinary(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("cannot open " + path);
+	}
+	return in;
+}
+
+template<typename T>
+Matrix<T> LoadBinaryMatrix(const std::string& path) {
+	std::ifstream in = OpenBinary(path);
+	return ReadBinaryMatrix<T>(in);
+}
+
+template<typename T>
+Poly<T> LoadBinaryPoly(const std::string& path) {
+	std::ifstream in = OpenBinary(path);
+	return ReadBinaryPoly<T>(in);
+}
+
+template<typename T>
+Basis<T> LoadBinaryBasis(const std::string& path) {
+	std::ifstream in = OpenBinary(path);
+	return ReadBinaryBasis<T>(in);
+}
+
+inline Rational LoadBinaryRational(const std::string& path) {
+	std::ifstream in = OpenBinary(path);
+	return ReadBinaryRational(in);
+}
+
+// Read-only mapping of a whole file, unmapped when the last reference goes away
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* Data() const {
+		return data;
+	}
+	size_t Size() const {
+		return size;
+	}
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
+
+// Read-only matrix whose elements stay in a mapped file: nothing is copied, pages are read on first touch.
+// Copies share the mapping. Only element types stored as raw memory can be viewed.
+template<typename T>
+class MatrixView {
+public:
+	static_assert(BinaryElementTraits<T>::supported && BinaryElementTraits<T>::raw, "MatrixView needs an element type stored as raw memory");
+
+	explicit MatrixView(const std::string& path) : file(std::make_shared<const MappedFile>(path)) {
+		if (file->Size() < sizeof(BinaryHeader)) {
+			throw std::runtime_error("binary header is truncated");
+		}
+
+		BinaryHeader header;
+		std::memcpy(&header, file->Data(), sizeof(header));
+		CheckBinaryHeader(header, BinaryKind::Matrix, BinaryElementTraits<T>::tag, sizeof(T), BinaryElementTraits<T>::Modulus());
+		CheckBinaryPayload(header, true, sizeof(T), file->Size() - sizeof(header));
+		height = header.height;
+		width = header.width;
+		data = reinterpret_cast<const T*>(file->Data() + sizeof(header));
+	}
+
+	size_t Height() const {
+		return height;
+	}
+	size_t Width() const {
+		return width;
+	}
+
+	const T* Data() const {
+		return data;
+	}
+
+	MatrixRowIterator<const T> begin() const {
+		return MatrixRowIterator<const T>(data, width, 0);
+	}
+	MatrixRowIterator<const T> end() const {
+		return MatrixRowIterator<const T>(data, width, height);
+	}
+
+	MatrixRow<const T> operator[](size_t i) const {
+		return MatrixRow<const T>(data + i * width, width);
+	}
+
+	Matrix<T> ToMatrix() const {
+		Matrix<T> result(height, width);
+		std::copy(data, data + height * width, result.GetData().begin());
+		return result;
+	}
+
+	// Products read the mapping directly
+	friend Matrix<T> operator*(const MatrixView& first, const Matrix<T>& second) {
+		if (first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.Height(), second.Width());
+		Gemm(first.Height(), second.Width(), first.Width(), first.data, first.Width(), second.GetData().data(), second.Width(), result.GetData().data(), result.Width());
+		return result;
+	}
+	friend Matrix<T> operator*(const Matrix<T>& first, const MatrixView& second) {
+		if (first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.Height(), second.Width());
+		Gemm(first.Height(), second.Width(), first.Width(), first.GetData().data(), first.Width(), second.data, second.Width(), result.GetData().data(), result.Width());
+		return result;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const MatrixView& m) {
+		WriteMatrixTable(out, m);
+		return out;
+	}
+
+private:
+	std::shared_ptr<const MappedFile> file;
+	const T* data;
+	size_t height, width;
+};
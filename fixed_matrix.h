@@ -0,0 +1,333 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <array>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+// Matrix with sizes known at compile time. Elements live inline, there are no allocations and
+// no runtime size checks: mismatched sizes simply do not compile.
+template<typename T, size_t R, size_t C>
+class FixedMatrix {
+public:
+	constexpr FixedMatrix() : data{} {}
+	constexpr explicit FixedMatrix(const T& value) : data{} {
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				data[i][j] = value;
+	}
+	constexpr FixedMatrix(std::initializer_list<std::initializer_list<T>> rows) : data{} {
+		if (rows.size() != R) {
+			throw UnsuitableMatrixSizes("initializer list does not match the sizes of FixedMatrix");
+		}
+
+		size_t i = 0;
+		for (const auto& row : rows) {
+			if (row.size() != C) {
+				throw UnsuitableMatrixSizes("initializer list does not match the sizes of FixedMatrix");
+			}
+
+			size_t j = 0;
+			for (const auto& x : row)
+				data[i][j++] = x;
+			++i;
+		}
+	}
+	explicit FixedMatrix(const Matrix<T>& second) : data{} {
+		if (second.Height() != R || second.Width() != C) {
+			throw UnsuitableMatrixSizes("Matrix does not match the sizes of FixedMatrix");
+		}
+
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				data[i][j] = second[i][j];
+	}
+
+	operator Matrix<T>() const {
+		Matrix<T> result(R, C);
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				result[i][j] = data[i][j];
+
+		return result;
+	}
+
+	static constexpr FixedMatrix E() {
+		FixedMatrix result;
+		for (size_t i = 0; i < R && i < C; ++i)
+			result[i][i] = T{ 1 };
+
+		return result;
+	}
+
+	static constexpr size_t Height() {
+		return R;
+	}
+	static constexpr size_t Width() {
+		return C;
+	}
+
+	constexpr std::array<T, C>& operator[](size_t i) {
+		return data[i];
+	}
+	constexpr const std::array<T, C>& operator[](size_t i) const {
+		return data[i];
+	}
+
+	friend constexpr bool operator==(const FixedMatrix& first, const FixedMatrix& second) {
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				if (!(first[i][j] == second[i][j]))
+					return false;
+
+		return true;
+	}
+	friend constexpr bool operator!=(const FixedMatrix& first, const FixedMatrix& second) {
+		return !(first == second);
+	}
+
+	constexpr FixedMatrix operator+() const {
+		return *this;
+	}
+	constexpr FixedMatrix operator-() const {
+		FixedMatrix result;
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				result[i][j] = -data[i][j];
+
+		return result;
+	}
+
+	friend constexpr FixedMatrix operator+(FixedMatrix first, const FixedMatrix& second) {
+		return first += second;
+	}
+	friend constexpr FixedMatrix operator-(FixedMatrix first, const FixedMatrix& second) {
+		return first -= second;
+	}
+	friend constexpr FixedMatrix operator*(FixedMatrix first, const T& second) {
+		return first *= second;
+	}
+	friend constexpr FixedMatrix operator*(const T& first, FixedMatrix second) {
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				second[i][j] = first * second[i][j];
+
+		return second;
+	}
+	// The inner sizes are matched by the template itself
+	template<size_t C2>
+	friend constexpr FixedMatrix<T, R, C2> operator*(const FixedMatrix& first, const FixedMatrix<T, C, C2>& second) {
+		FixedMatrix<T, R, C2> result;
+		for (size_t i = 0; i < R; ++i)
+			for (size_t k = 0; k < C; ++k)
+				for (size_t j = 0; j < C2; ++j)
+					result[i][j] += first[i][k] * second[k][j];
+
+		return result;
+	}
+	friend constexpr FixedMatrix operator^(FixedMatrix first, long long second) {
+		static_assert(R == C, "operator^ must take squere matrix");
+
+		// |second| as unsigned, so that LLONG_MIN does not overflow
+		unsigned long long k = static_cast<unsigned long long>(second);
+		if (second < 0) {
+			if constexpr (IsField<T>) {
+				first.Inverse();
+				k = 0 - k;
+			}
+			else {
+				throw std::domain_error("negative powers need an element type with division");
+			}
+		}
+
+		FixedMatrix result = E();
+		for (; k > 0; k >>= 1, first *= first)
+			if (k & 1)
+				result *= first;
+
+		return result;
+	}
+
+	constexpr FixedMatrix& operator+=(const FixedMatrix& second) {
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				data[i][j] += second[i][j];
+
+		return *this;
+	}
+	constexpr FixedMatrix& operator-=(const FixedMatrix& second) {
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				data[i][j] -= second[i][j];
+
+		return *this;
+	}
+	constexpr FixedMatrix& operator*=(const T& second) {
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				data[i][j] *= second;
+
+		return *this;
+	}
+	constexpr FixedMatrix& operator*=(const FixedMatrix<T, C, C>& second) {
+		return *this = *this * second;
+	}
+	constexpr FixedMatrix& operator^=(long long second) {
+		return *this = (*this ^ second);
+	}
+
+	constexpr FixedMatrix<T, C, R> Transposed() const {
+		FixedMatrix<T, C, R> result;
+		for (size_t i = 0; i < R; ++i)
+			for (size_t j = 0; j < C; ++j)
+				result[j][i] = data[i][j];
+
+		return result;
+	}
+
+	constexpr T Det() const {
+		static_assert(R == C, "Det must take squere matrix");
+
+		if constexpr (R == 0)
+			return T{ 1 };
+		else if constexpr (R == 1)
+			return data[0][0];
+		else if constexpr (R == 2)
+			return data[0][0] * data[1][1] - data[0][1] * data[1][0];
+		else if constexpr (R == 3)
+			return data[0][0] * (data[1][1] * data[2][2] - data[1][2] * data[2][1])
+				- data[0][1] * (data[1][0] * data[2][2] - data[1][2] * data[2][0])
+				+ data[0][2] * (data[1][0] * data[2][1] - data[1][1] * data[2][0]);
+		else if constexpr (IsField<T>) {
+			FixedMatrix help = *this;
+			T result{ 1 };
+			for (size_t j = 0; j < R; ++j) {
+				size_t pivot = help.Pivot(j, j);
+				if (help[pivot][j] == 0)
+					return T{ 0 };
+				if (pivot != j) {
+					help.SwapRows(pivot, j);
+					result = -result;
+				}
+				result *= help[j][j];
+
+				for (size_t i1 = j + 1; i1 < R; ++i1) {
+					T f = help[i1][j] / help[j][j];
+					for (size_t j1 = j + 1; j1 < C; ++j1)
+						help[i1][j1] -= f * help[j][j1];
+				}
+			}
+
+			return result;
+		}
+		else {
+			// Bareiss, all divisions are exact
+			FixedMatrix help = *this;
+			T previous{ 1 };
+			bool negate = false;
+			for (size_t j = 0; j < R; ++j) {
+				size_t pivot = help.Pivot(j, j);
+				if (help[pivot][j] == 0)
+					return T{ 0 };
+				if (pivot != j) {
+					help.SwapRows(pivot, j);
+					negate = !negate;
+				}
+
+				for (size_t i1 = j + 1; i1 < R; ++i1)
+					for (size_t j1 = j + 1; j1 < C; ++j1)
+						help[i1][j1] = (help[i1][j1] * help[j][j] - help[i1][j] * help[j][j1]) / previous;
+				previous = help[j][j];
+			}
+
+			return (negate ? -help[R - 1][R - 1] : help[R - 1][R - 1]);
+		}
+	}
+
+	constexpr FixedMatrix& Inverse() {
+		static_assert(R == C, "Inverse must take squere matrix");
+		static_assert(IsField<T>, "Inverse needs an element type with division");
+
+		if constexpr (R == 2) {
+			T det = Det();
+			if (det == 0) {
+				throw std::runtime_error("Degenerate matrix");
+			}
+
+			T d = 1 / det;
+			FixedMatrix result;
+			result[0][0] = data[1][1] * d;
+			result[0][1] = -data[0][1] * d;
+			result[1][0] = -data[1][0] * d;
+			result[1][1] = data[0][0] * d;
+			return *this = result;
+		}
+		else {
+			FixedMatrix help = *this;
+			*this = E();
+			for (size_t j = 0; j < C; ++j) {
+				size_t pivot = help.Pivot(j, j);
+				if (help[pivot][j] == 0) {
+					throw std::runtime_error("Degenerate matrix");
+				}
+				help.SwapRows(pivot, j);
+				SwapRows(pivot, j);
+
+				T d = 1 / help[j][j];
+				for (size_t j1 = 0; j1 < C; ++j1) {
+					help[j][j1] *= d;
+					data[j][j1] *= d;
+				}
+
+				for (size_t i1 = 0; i1 < R; ++i1) {
+					if (i1 == j)
+						continue;
+
+					T f = help[i1][j];
+					for (size_t j1 = 0; j1 < C; ++j1) {
+						help[i1][j1] -= f * help[j][j1];
+						data[i1][j1] -= f * data[j][j1];
+					}
+				}
+			}
+
+			return *this;
+		}
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const FixedMatrix& m) {
+		WriteMatrixTable(out, m);
+		return out;
+	}
+
+private:
+	std::array<std::array<T, C>, R> data;
+
+	// std::swap is not constexpr before C++20
+	constexpr void SwapRows(size_t i1, size_t i2) {
+		for (size_t j = 0; j < C; ++j) {
+			T x = data[i1][j];
+			data[i1][j] = data[i2][j];
+			data[i2][j] = x;
+		}
+	}
+
+	// Row in [from, R) to eliminate column j with: the largest one for floating point, the first nonzero otherwise
+	constexpr size_t Pivot(size_t from, size_t j) const {
+		size_t pivot = from;
+		for (size_t i1 = from; i1 < R; ++i1) {
+			if constexpr (std::is_floating_point<T>::value) {
+				if ((data[i1][j] < 0 ? -data[i1][j] : data[i1][j]) > (data[pivot][j] < 0 ? -data[pivot][j] : data[pivot][j]))
+					pivot = i1;
+			}
+			else if (data[i1][j] != 0) {
+				return i1;
+			}
+		}
+
+		return pivot;
+	}
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// All routines compute C += A * B, where A is m x k, B is k x n and C is m x n.
+// Matrices are row-major, ld* is the distance between the starts of two consecutive rows.
+
+template<typename T>
+struct GemmTraits {
+	// Micro-kernel tile, the accumulators of one tile are meant to stay in registers
+	static constexpr size_t MR = 4;
+	static constexpr size_t NR = std::max<size_t>(4, 64 / sizeof(T));
+	// Cache blocks: KC x NR sliver of B fits L1, MC x KC block of A fits L2, KC x NC panel of B fits L3
+	static constexpr size_t KC = 256;
+	static constexpr size_t MC = 96;
+	static constexpr size_t NC = 2048;
+};
+
+template<typename T>
+constexpr bool UseBlockedGemm = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value;
+
+// For types like Rational and Poly, where a scalar operation is far more expensive than a cache miss
+template<typename T>
+void GemmGeneric(size_t m, size_t n, size_t k, const T* a, size_t lda, const T* b, size_t ldb, T* c, size_t ldc) {
+	for (size_t i = 0; i < m; ++i) {
+		T* ci = c + i * ldc;
+		for (size_t p = 0; p < k; ++p) {
+			const T& aip = a[i * lda + p];
+			const T* bp = b + p * ldb;
+			for (size_t j = 0; j < n; ++j) {
+				ci[j] += aip * bp[j];
+			}
+		}
+	}
+}
+
+// Copies an mc x kc block of A into slivers of MR rows stored column by column, padding with zeros
+template<typename T>
+void GemmPackA(size_t mc, size_t kc, const T* a, size_t lda, T* packed) {
+	constexpr size_t MR = GemmTraits<T>::MR;
+	for (size_t i0 = 0; i0 < mc; i0 += MR) {
+		const size_t mr = std::min(MR, mc - i0);
+		for (size_t p = 0; p < kc; ++p) {
+			for (size_t i = 0; i < mr; ++i) {
+				packed[i] = a[(i0 + i) * lda + p];
+			}
+			std::fill(packed + mr, packed + MR, T{});
+			packed += MR;
+		}
+	}
+}
+
+// Copies a kc x nc panel of B into slivers of NR columns stored row by row, padding with zeros
+template<typename T>
+void GemmPackB(size_t kc, size_t nc, const T* b, size_t ldb, T* packed) {
+	constexpr size_t NR = GemmTraits<T>::NR;
+	for (size_t j0 = 0; j0 < nc; j0 += NR) {
+		const size_t nr = std::min(NR, nc - j0);
+		for (size_t p = 0; p < kc; ++p) {
+			const T* bp = b + p * ldb + j0;
+			std::copy(bp, bp + nr, packed);
+			std::fill(packed + nr, packed + NR, T{});
+			packed += NR;
+		}
+	}
+}
+
+// C[0..mr)[0..nr) += packed A sliver * packed B sliver
+template<typename T>
+void GemmMicroKernel(size_t kc, const T* a, const T* b, T* c, size_t ldc, size_t mr, size_t nr) {
+	constexpr size_t MR = GemmTraits<T>::MR;
+	constexpr size_t NR = GemmTraits<T>::NR;
+
+	if constexpr (std::is_same<T, double>::value || std::is_same<T, float>::value) {
+		static_assert(MR == 4 && NR * sizeof(T) == 64, "tile does not match the vector kernels in simd.cpp");
+		if (SimdGemmMicroKernel(kc, a, b, c, ldc, mr, nr)) {
+			return;
+		}
+	}
+
+	T acc[MR][NR] = {};
+	for (size_t p = 0; p < kc; ++p, a += MR, b += NR) {
+		for (size_t i = 0; i < MR; ++i) {
+			const T ai = a[i];
+			for (size_t j = 0; j < NR; ++j) {
+				acc[i][j] += ai * b[j];
+			}
+		}
+	}
+
+	for (size_t i = 0; i < mr; ++i) {
+		for (size_t j = 0; j < nr; ++j) {
+			c[i * ldc + j] += acc[i][j];
+		}
+	}
+}
+
+template<typename T>
+void GemmBlocked(size_t m, size_t n, size_t k, const T* a, size_t lda, const T* b, size_t ldb, T* c, size_t ldc) {
+	using Traits = GemmTraits<T>;
+	constexpr size_t MR = Traits::MR, NR = Traits::NR, KC = Traits::KC, MC = Traits::MC, NC = Traits::NC;
+
+	std::vector<T> packedA(MC * KC), packedB(std::min(NC, (n + NR - 1) / NR * NR) * KC);
+	for (size_t j0 = 0; j0 < n; j0 += NC) {
+		const size_t nc = std::min(NC, n - j0);
+		for (size_t p0 = 0; p0 < k; p0 += KC) {
+			const size_t kc = std::min(KC, k - p0);
+			GemmPackB(kc, nc, b + p0 * ldb + j0, ldb, packedB.data());
+
+			for (size_t i0 = 0; i0 < m; i0 += MC) {
+				const size_t mc = std::min(MC, m - i0);
+				GemmPackA(mc, kc, a + i0 * lda + p0, lda, packedA.data());
+
+				for (size_t j1 = 0; j1 < nc; j1 += NR) {
+					for (size_t i1 = 0; i1 < mc; i1 += MR) {
+						GemmMicroKernel(kc, packedA.data() + i1 * kc, packedB.data() + j1 * kc,
+							c + (i0 + i1) * ldc + j0 + j1, ldc, std::min(MR, mc - i1), std::min(NR, nc - j1));
+					}
+				}
+			}
+		}
+	}
+}
+
+template<typename T>
+void GemmClassic(size_t m, size_t n, size_t k, const T* a, size_t lda, const T* b, size_t ldb, T* c, size_t ldc) {
+	// Row blocks of C are independent, each thread gets at least about 64^3 multiply-adds
+	const size_t grain = std::max<size_t>(GemmTraits<T>::MR, 64 * 64 * 64 / std::max<size_t>(n * k, 1));
+	ParallelFor(0, m, grain, [&](size_t lo, size_t hi) {
+		const size_t rows = hi - lo;
+		if constexpr (UseBlockedGemm<T>) {
+			// Packing does not pay off on tiny products
+			if (rows * n * k >= 32 * 32 * 32) {
+				GemmBlocked(rows, n, k, a + lo * lda, lda, b, ldb, c + lo * ldc, ldc);
+				return;
+			}
+		}
+		GemmGeneric(rows, n, k, a + lo * lda, lda, b, ldb, c + lo * ldc, ldc);
+	});
+}
+
+template<uint64_t P>
+class ModInt;
+
+// Types the Strassen-Winograd recursion is safe for: floating point, and ModInt, whose sums wrap modulo P anyway.
+// The pre-additions make entries up to 4 times larger, which can overflow integers where the classic product
+// does not, and they make Rational and Poly coefficients grow.
+template<typename T>
+struct StrassenByDefault : std::is_floating_point<T> {};
+template<uint64_t P>
+struct StrassenByDefault<ModInt<P>> : std::true_type {};
+
+// Products with all three sizes at least this large go through Strassen-Winograd recursion.
+// Can be tuned per type at runtime, SIZE_MAX turns the sub-cubic mode off. It is off by default for types
+// other than StrassenByDefault ones; integers opt in by setting it when their entries are known to be small.
+template<typename T>
+size_t& StrassenCrossover() {
+	static size_t crossover = (!StrassenByDefault<T>::value ? SIZE_MAX : UseBlockedGemm<T> ? 1024 : 64);
+	return crossover;
+}
+
+// c = first op second, elementwise over an m x n block
+template<typename T, typename Op>
+void GemmCombine(size_t m, size_t n, const T* first, size_t ld1, const T* second, size_t ld2, T* c, size_t ldc, Op op) {
+	for (size_t i = 0; i < m; ++i) {
+		for (size_t j = 0; j < n; ++j) {
+			c[i * ldc + j] = op(first[i * ld1 + j], second[i * ld2 + j]);
+		}
+	}
+}
+
+template<typename T>
+void GemmStrassen(size_t m, size_t n, size_t k, const T* a, size_t lda, const T* b, size_t ldb, T* c, size_t ldc) {
+	if (std::min({ m, n, k }) < std::max<size_t>(StrassenCrossover<T>(), 2)) {
+		GemmClassic(m, n, k, a, lda, b, ldb, c, ldc);
+		return;
+	}
+
+	// Odd sizes: recurse on the even core and peel the last row / column / inner index off
+	const size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+	if (m % 2 || n % 2 || k % 2) {
+		GemmStrassen(2 * m2, 2 * n2, 2 * k2, a, lda, b, ldb, c, ldc);
+		if (k % 2) {
+			GemmClassic(2 * m2, 2 * n2, 1, a + 2 * k2, lda, b + 2 * k2 * ldb, ldb, c, ldc);
+		}
+		if (n % 2) {
+			GemmClassic(2 * m2, 1, k, a, lda, b + 2 * n2, ldb, c + 2 * n2, ldc);
+		}
+		if (m % 2) {
+			GemmClassic(1, n, k, a + 2 * m2 * lda, lda, b, ldb, c + 2 * m2 * ldc, ldc);
+		}
+		return;
+	}
+
+	const auto plus = [](const T& x, const T& y) { return x + y; };
+	const auto minus = [](const T& x, const T& y) { return x - y; };
+
+	const T *a11 = a, *a12 = a + k2, *a21 = a + m2 * lda, *a22 = a21 + k2;
+	const T *b11 = b, *b12 = b + n2, *b21 = b + k2 * ldb, *b22 = b21 + n2;
+	T *c11 = c, *c12 = c + n2, *c21 = c + m2 * ldc, *c22 = c21 + n2;
+
+	std::vector<T> s1(m2 * k2), s2(m2 * k2), s3(m2 * k2), s4(m2 * k2);
+	GemmCombine(m2, k2, a21, lda, a22, lda, s1.data(), k2, plus);
+	GemmCombine(m2, k2, s1.data(), k2, a11, lda, s2.data(), k2, minus);
+	GemmCombine(m2, k2, a11, lda, a21, lda, s3.data(), k2, minus);
+	GemmCombine(m2, k2, a12, lda, s2.data(), k2, s4.data(), k2, minus);
+
+	// t4 is negated compared to the textbook form, so that every product is accumulated with +
+	std::vector<T> t1(k2 * n2), t2(k2 * n2), t3(k2 * n2), t4(k2 * n2);
+	GemmCombine(k2, n2, b12, ldb, b11, ldb, t1.data(), n2, minus);
+	GemmCombine(k2, n2, b22, ldb, t1.data(), n2, t2.data(), n2, minus);
+	GemmCombine(k2, n2, b22, ldb, b12, ldb, t3.data(), n2, minus);
+	GemmCombine(k2, n2, b21, ldb, t2.data(), n2, t4.data(), n2, minus);
+
+	// u = p1, then p1 + p6, then p1 + p6 + p5; v = p1 + p6 + p7; w = p5
+	std::vector<T> u(m2 * n2), v(m2 * n2), w(m2 * n2);
+	GemmStrassen(m2, n2, k2, a11, lda, b11, ldb, u.data(), n2);
+	GemmCombine(m2, n2, c11, ldc, u.data(), n2, c11, ldc, plus);
+	GemmStrassen(m2, n2, k2, a12, lda, b21, ldb, c11, ldc);
+
+	GemmStrassen(m2, n2, k2, s2.data(), k2, t2.data(), n2, u.data(), n2);
+	v = u;
+	GemmStrassen(m2, n2, k2, s3.data(), k2, t3.data(), n2, v.data(), n2);
+	GemmStrassen(m2, n2, k2, s1.data(), k2, t1.data(), n2, w.data(), n2);
+	GemmCombine(m2, n2, u.data(), n2, w.data(), n2, u.data(), n2, plus);
+
+	GemmCombine(m2, n2, c12, ldc, u.data(), n2, c12, ldc, plus);
+	GemmStrassen(m2, n2, k2, s4.data(), k2, b22, ldb, c12, ldc);
+
+	GemmCombine(m2, n2, c21, ldc, v.data(), n2, c21, ldc, plus);
+	GemmStrassen(m2, n2, k2, a22, lda, t4.data(), n2, c21, ldc);
+
+	GemmCombine(m2, n2, c22, ldc, v.data(), n2, c22, ldc, plus);
+	GemmCombine(m2, n2, c22, ldc, w.data(), n2, c22, ldc, plus);
+}
+
+template<typename T>
+void Gemm(size_t m, size_t n, size_t k, const T* a, size_t lda, const T* b, size_t ldb, T* c, size_t ldc) {
+	GemmStrassen(m, n, k, a, lda, b, ldb, c, ldc);
+}
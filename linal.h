@@ -1,7 +1,12 @@
-#pragma once
+﻿#pragma once
 
+#include "lu_decomposition.h"
 #include "matrix.h"
+#include "sparse_matrix.h"
 
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
 #include <vector>
 
 template<typename T>
@@ -47,6 +52,20 @@ Basis<T> SpanBasis(Basis<T> v)
 	Matrix<T> h = BasisToMatrix(v);
 	h.Transpose();
 
+	if constexpr (UseFractionFree<T>)
+	{
+		// The leading rows of the echelon form are the independent vectors, in their original order
+		std::vector<size_t> order;
+		h.ToFractionFreeForm(&order);
+
+		Basis<T> res;
+		for (size_t i = 0, j = 0; i < h.Height() && j < h.Width(); ++j)
+			if (h[i][j] != 0)
+				res.push_back(v[order[i++]]);
+
+		return res;
+	}
+
 	int i = 0;
 	for (int j = 0; i < h.Height() && j < h.Width(); ++j) {
 		for (int i1 = i; i1 < h.Height(); ++i1) {
@@ -54,7 +73,7 @@ Basis<T> SpanBasis(Basis<T> v)
 				// for it to be stable (abcd -> dabc)
 				for (int x = i1 - 1; x >= i; --x)
 				{
-					swap(h[x], h[x + 1]);
+					h.SwapRows(x, x + 1);
 					std::swap(v[x], v[x + 1]);
 				}
 				break;
@@ -75,9 +94,9 @@ Basis<T> SpanBasis(Basis<T> v)
 				continue;
 			}
 
-			T d = h[i1][j];
-			for (int j1 = 0; j1 < h.Width(); ++j1) {
-				h[i1][j1] -= d * h[i][j1];
+			const T d = -h[i1][j];
+			if (d != 0) {
+				Axpy(h.Width(), d, h[i].begin(), h[i1].begin());
 			}
 		}
 		++i;
@@ -107,17 +126,23 @@ Basis<T> IntersectionBasis(Basis<T> u, Basis<T> v)
 	Matrix<T> U = BasisToMatrix(u);
 	for (auto& i : res)
 	{
-		i.GetData().resize(u.size());
+		i.Resize(u.size(), 1);
 		i = U * i;
 	}
 
 	return SpanBasis(res);
 }
 
+// For integers and fractions the elimination is fraction-free and rescaling waits until the end:
+// fractions get 1 at the free variable as usual, integers get the primitive integer vector.
 template<typename T>
 Basis<T> KerBasis(Matrix<T> A)
 {
-	A.ToLadderForm();
+	if constexpr (UseFractionFree<T>)
+		A.ToFractionFreeForm();
+	else
+		A.ToLadderForm();
+
 	std::vector<int> mainvar, freevar;
 	for (int i = 0, j = 0; j < A.Width(); ++j)
 	{
@@ -130,6 +155,9 @@ Basis<T> KerBasis(Matrix<T> A)
 		}
 	}
 
+	// Every pivot of the fraction-free form equals the last one
+	const T d = (UseFractionFree<T> && !mainvar.empty() ? A[mainvar.size() - 1][mainvar.back()] : T{ 1 });
+
 	Basis<T> res;
 	for (auto& j : freevar)
 	{
@@ -137,7 +165,24 @@ Basis<T> KerBasis(Matrix<T> A)
 		for (int i = 0; i < mainvar.size(); ++i)
 			cur[mainvar[i]][0] = -A[i][j];
 
-		cur[j][0] = 1;
+		cur[j][0] = d;
+
+		if constexpr (std::is_integral<T>::value)
+		{
+			T g = 0;
+			for (auto& x : cur.GetData())
+				g = std::gcd(g, x);
+			if (d < 0)
+				g = -g;
+			for (auto& x : cur.GetData())
+				x /= g;
+		}
+		else if (d != 1)
+		{
+			const T inverse = 1 / d;
+			for (auto& x : cur.GetData())
+				x *= inverse;
+		}
 
 		res.push_back(cur);
 	}
@@ -151,10 +196,114 @@ Basis<T> ImBasis(Matrix<T> A)
 	return SpanBasis(MatrixToBasis(A));
 }
 
+// Free columns of the echelon form are set to 1 one at a time, pivots are then solved in reverse order.
+// Integers keep the vector integral by rescaling it at every pivot and return it primitive, free entry positive.
+template<typename T>
+Basis<T> KerBasis(const SparseMatrix<T>& A)
+{
+	const SparseEchelonForm<T> echelon = A.Echelon();
+	std::vector<bool> pivot(A.Width(), false);
+	for (size_t j : echelon.pivotColumns)
+		pivot[j] = true;
+
+	std::vector<size_t> freevar;
+	for (size_t j = 0; j < A.Width(); ++j)
+		if (!pivot[j])
+			freevar.push_back(j);
+
+	Basis<T> res(freevar.size());
+	ParallelFor(0, freevar.size(), 1, [&](size_t lo, size_t hi) {
+		for (size_t f = lo; f < hi; ++f)
+		{
+			Matrix<T> cur(A.Width(), 1);
+			cur[freevar[f]][0] = 1;
+			for (size_t k = echelon.pivotRows.size(); k-- > 0;)
+			{
+				const size_t c = echelon.pivotColumns[k];
+				T sum{ 0 }, lead{ 1 };
+				for (const auto& [j, value] : echelon.pivotRows[k])
+				{
+					if (j == c)
+						lead = value;
+					else if (cur[j][0] != 0)
+						sum += value * cur[j][0];
+				}
+				if constexpr (std::is_integral<T>::value)
+				{
+					// lead * x = -sum has an integer solution once the vector is scaled by lead / gcd(lead, sum)
+					const T g = std::gcd(lead, sum), scale = lead / g;
+					if (scale != 1)
+						for (auto& x : cur.GetData())
+							x *= scale;
+					cur[c][0] = -sum / g;
+				}
+				else
+					cur[c][0] = -sum / lead;
+			}
+
+			if constexpr (std::is_integral<T>::value)
+			{
+				T g = 0;
+				for (auto& x : cur.GetData())
+					g = std::gcd(g, x);
+				if (cur[freevar[f]][0] < 0)
+					g = -g;
+				for (auto& x : cur.GetData())
+					x /= g;
+			}
+			res[f] = std::move(cur);
+		}
+	});
+
+	return res;
+}
+
+// Pivot columns of the echelon form are linearly independent columns of A
+template<typename T>
+Basis<T> ImBasis(const SparseMatrix<T>& A)
+{
+	std::vector<size_t> mainvar = A.Echelon().pivotColumns;
+	std::sort(mainvar.begin(), mainvar.end());
+
+	const SparseMatrix<T> columns = A.Transposed();
+	Basis<T> res(mainvar.size(), Matrix<T>(A.Height(), 1));
+	for (size_t k = 0; k < mainvar.size(); ++k)
+		for (size_t p = columns.RowStarts()[mainvar[k]]; p < columns.RowStarts()[mainvar[k] + 1]; ++p)
+			res[k][columns.Columns()[p]][0] = columns.Values()[p];
+
+	return res;
+}
+
+// Same elimination as KerBasis: fraction-free for integers, where 1 / pivot would truncate to 0
+template<typename T>
+size_t Rank(Matrix<T> A)
+{
+	if constexpr (UseFractionFree<T>)
+		A.ToFractionFreeForm();
+	else
+		A.ToLadderForm();
+
+	size_t rank = 0;
+	for (size_t i = 0, j = 0; i < A.Height() && j < A.Width(); ++j)
+		if (A[i][j] != 0)
+		{
+			++rank;
+			++i;
+		}
+
+	return rank;
+}
+
+template<typename T>
+size_t Rank(const SparseMatrix<T>& A)
+{
+	return A.Rank();
+}
+
 template<typename T>
 Basis<T> EigenBasis(Matrix<T> A, T k)
 {
-	return KerBasis((A - k));
+	return KerBasis(std::move(A) - k);
 }
 
 template<typename T>
@@ -169,9 +318,10 @@ Matrix<T> Projector(Basis<T> u, Basis<T> v)
 	int k = u.size();
 	u.insert(u.end(), v.begin(), v.end());
 	
-	Matrix<T> F = BasisToMatrix(u), res(F.Height(), F.Width());
-	for (int i = 0; i < k; ++i)
-		res[i][i] = 1;
+	// F D F^-1 = ((F^T)^-1 (F D)^T)^T, D keeps the first k coordinates
+	Matrix<T> F = BasisToMatrix(u), res = F;
+	for (auto& row : res)
+		std::fill(row.begin() + k, row.end(), T{ 0 });
 
-	return F * res * (F ^ -1);
+	return LUDecomposition<T>(F.Transpose()).Solve(res.Transpose()).Transpose();
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "matrix.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// PA = LU with partial pivoting, computed once and reused for any number of right-hand sides.
+// L has a unit diagonal and is stored below the diagonal of the same matrix as U.
+template<typename T>
+class LUDecomposition {
+public:
+	static_assert(IsField<T>, "LUDecomposition needs an element type with division");
+
+	explicit LUDecomposition(Matrix<T> A) : lu(std::move(A)), pivots(lu.Height()), negate(false), singular(false) {
+		if (lu.Height() != lu.Width()) {
+			throw UnsuitableMatrixSizes("LUDecomposition must take squere matrix");
+		}
+
+		const size_t n = lu.Height();
+		for (size_t i = 0; i < n; ++i) {
+			pivots[i] = i;
+		}
+
+		for (size_t j = 0; j < n; ++j) {
+			size_t pivot = j;
+			for (size_t i1 = j; i1 < n; ++i1) {
+				if constexpr (std::is_floating_point<T>::value) {
+					if (std::abs(lu[i1][j]) > std::abs(lu[pivot][j]))
+						pivot = i1;
+				}
+				else if (lu[i1][j] != 0) {
+					pivot = i1;
+					break;
+				}
+			}
+
+			if (lu[pivot][j] == 0) {
+				singular = true;
+				continue;
+			}
+			if (pivot != j) {
+				lu.SwapRows(pivot, j);
+				std::swap(pivots[pivot], pivots[j]);
+				negate = !negate;
+			}
+
+			const T d = 1 / lu[j][j];
+			ParallelFor(j + 1, n, RowGrain(n), [&](size_t lo, size_t hi) {
+				for (size_t i1 = lo; i1 < hi; ++i1) {
+					if (lu[i1][j] == 0) {
+						continue;
+					}
+
+					const T f = lu[i1][j] * d;
+					lu[i1][j] = f;
+					Axpy(n - j - 1, T{ -f }, lu[j].begin() + j + 1, lu[i1].begin() + j + 1);
+				}
+			});
+		}
+	}
+
+	size_t Size() const {
+		return lu.Height();
+	}
+
+	bool IsSingular() const {
+		return singular;
+	}
+
+	// Row i of PA is row Pivots()[i] of A
+	const std::vector<size_t>& Pivots() const {
+		return pivots;
+	}
+
+	Matrix<T> L() const {
+		Matrix<T> result = Matrix<T>::E(Size(), Size());
+		for (size_t i = 0; i < Size(); ++i)
+			for (size_t j = 0; j < i; ++j)
+				result[i][j] = lu[i][j];
+
+		return result;
+	}
+	Matrix<T> U() const {
+		Matrix<T> result(Size(), Size());
+		for (size_t i = 0; i < Size(); ++i)
+			for (size_t j = i; j < Size(); ++j)
+				result[i][j] = lu[i][j];
+
+		return result;
+	}
+
+	T Det() const {
+		if (singular) {
+			return T{ 0 };
+		}
+
+		T result{ 1 };
+		for (size_t i = 0; i < Size(); ++i) {
+			result *= lu[i][i];
+		}
+
+		return (negate ? -result : result);
+	}
+
+	// X with AX = B. Columns of B are split into panels that are substituted independently.
+	Matrix<T> Solve(const Matrix<T>& b) const {
+		if (b.Height() != Size()) {
+			throw UnsuitableMatrixSizes("Solve must take a right-hand side with the height of the matrix");
+		}
+		if (singular) {
+			throw std::runtime_error("Degenerate matrix");
+		}
+
+		const size_t n = Size(), width = b.Width();
+		Matrix<T> x(n, width);
+		for (size_t i = 0; i < n; ++i) {
+			std::copy(b[pivots[i]].begin(), b[pivots[i]].end(), x[i].begin());
+		}
+
+		ParallelFor(0, width, SolvePanel, [&](size_t lo, size_t hi) {
+			for (size_t c0 = lo; c0 < hi; c0 += SolvePanel) {
+				const size_t w = std::min(SolvePanel, hi - c0);
+				for (size_t i = 0; i < n; ++i) {
+					for (size_t j = 0; j < i; ++j) {
+						if (lu[i][j] != 0) {
+							Axpy(w, T{ -lu[i][j] }, x[j].begin() + c0, x[i].begin() + c0);
+						}
+					}
+				}
+				for (size_t i = n; i-- > 0;) {
+					for (size_t j = i + 1; j < n; ++j) {
+						if (lu[i][j] != 0) {
+							Axpy(w, T{ -lu[i][j] }, x[j].begin() + c0, x[i].begin() + c0);
+						}
+					}
+
+					const T d = 1 / lu[i][i];
+					for (size_t k = c0; k < c0 + w; ++k) {
+						x[i][k] *= d;
+					}
+				}
+			}
+		});
+
+		return x;
+	}
+	std::vector<T> Solve(const std::vector<T>& b) const {
+		if (b.size() != Size()) {
+			throw UnsuitableMatrixSizes("Solve must take a right-hand side with the height of the matrix");
+		}
+
+		Matrix<T> column(Size(), 1);
+		for (size_t i = 0; i < Size(); ++i) {
+			column[i][0] = b[i];
+		}
+
+		return Solve(column).GetData();
+	}
+
+	Matrix<T> Inverse() const {
+		return Solve(Matrix<T>::E(Size(), Size()));
+	}
+
+private:
+	Matrix<T> lu;
+	std::vector<size_t> pivots;
+	bool negate, singular;
+
+	// Columns of the right-hand side substituted together, a panel of n rows should stay in cache
+	static constexpr size_t SolvePanel = 256;
+
+	static size_t RowGrain(size_t width) {
+		return std::max<size_t>(1, (1 << 14) / std::max<size_t>(width, 1));
+	}
+};
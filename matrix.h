@@ -1,20 +1,48 @@
 ﻿#pragma once
 
+#include "gemm.h"
 #include "poly.h"
 #include "permutation.h"
+#include "simd.h"
+#include "text_format.h"
+#include "thread_pool.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
+#include <iterator>
 #include <iostream>
 #include <functional>
 #include <sstream>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <exception>
+#include <stdexcept>
+
+template<typename T, typename = void>
+struct HasDivision : std::false_type {};
+template<typename T>
+struct HasDivision<T, std::void_t<decltype(std::declval<T>() / std::declval<T>())>> : std::true_type {};
+
+// Types where every nonzero element can be inverted exactly or approximately, e.g. double and Rational but not int
+template<typename T>
+constexpr bool IsField = !std::is_integral<T>::value && HasDivision<T>::value;
+
+template<typename T, typename = void>
+struct HasDenominator : std::false_type {};
+template<typename T>
+struct HasDenominator<T, std::void_t<decltype(std::declval<const T&>().Denominator())>> : std::true_type {};
+
+// Exact types whose elimination is better done fraction-free: integers, and fractions once rows are scaled to integers
+template<typename T>
+constexpr bool UseFractionFree = std::is_integral<T>::value || HasDenominator<T>::value;
 
 class UnsuitableMatrixSizes : public std::exception {
 public:
 	UnsuitableMatrixSizes(const char* whatStr = "unsuitable matrix sizes") : whatStr(whatStr) {}
 
-	const char* what() const override {
+	const char* what() const noexcept override {
 		return whatStr;
 	}
 
@@ -23,21 +51,254 @@ private:
 };
 
 template<typename T>
-class Matrix {
+class MatrixRow {
+public:
+	MatrixRow(T* data, size_t width) : data(data), width(width) {}
+
+	operator MatrixRow<const T>() const {
+		return MatrixRow<const T>(data, width);
+	}
+	operator std::vector<std::remove_const_t<T>>() const {
+		return std::vector<std::remove_const_t<T>>(begin(), end());
+	}
+
+	size_t size() const {
+		return width;
+	}
+
+	T* begin() const {
+		return data;
+	}
+	T* end() const {
+		return data + width;
+	}
+
+	T& operator[](size_t j) const {
+		return data[j];
+	}
+
+	// Rows are views, so swapping them swaps the elements, not the views
+	friend void swap(MatrixRow first, MatrixRow second) {
+		std::swap_ranges(first.begin(), first.end(), second.begin());
+	}
+
+private:
+	T* data;
+	size_t width;
+};
+
+template<typename T>
+class MatrixRowIterator {
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = MatrixRow<T>;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const MatrixRow<T>*;
+	using reference = const MatrixRow<T>&;
+
+	MatrixRowIterator(T* data, size_t width, size_t i) : row(data + i * width, width), i(i) {}
+
+	// The view is stored inside the iterator so that "for (auto& row : m)" keeps working
+	const MatrixRow<T>& operator*() const {
+		return row;
+	}
+	const MatrixRow<T>* operator->() const {
+		return &row;
+	}
+
+	MatrixRowIterator& operator++() {
+		row = MatrixRow<T>(row.end(), row.size());
+		++i;
+		return *this;
+	}
+	MatrixRowIterator operator++(int) {
+		MatrixRowIterator result = *this;
+		++(*this);
+		return result;
+	}
+
+	friend bool operator==(const MatrixRowIterator& first, const MatrixRowIterator& second) {
+		return first.i == second.i;
+	}
+	friend bool operator!=(const MatrixRowIterator& first, const MatrixRowIterator& second) {
+		return first.i != second.i;
+	}
+
+private:
+	MatrixRow<T> row;
+	size_t i;
+};
+
+template<typename T>
+class Matrix;
+
+class MatrixExpressionTag {};
+
+template<typename T>
+constexpr bool IsMatrixExpression = std::is_base_of<MatrixExpressionTag, T>::value;
+
+// Elementwise arithmetic is lazy: A + B - 2 * C builds a small tree of nodes and the whole tree
+// is evaluated in one pass, without temporaries, when it is converted or assigned to a Matrix.
+// Nodes refer to Matrix operands, so an expression must not outlive the matrices it was built from.
+template<typename E, typename T>
+class MatrixExpression : public MatrixExpressionTag {
+public:
+	using value_type = T;
+
+	const E& Self() const {
+		return static_cast<const E&>(*this);
+	}
+};
+
+// Matrices are held by reference, intermediate nodes by value
+template<typename E>
+using MatrixOperand = std::conditional_t<std::is_same<E, Matrix<typename E::value_type>>::value, const E&, const E>;
+
+template<typename E1, typename E2, typename T, typename Op>
+class MatrixBinaryExpression : public MatrixExpression<MatrixBinaryExpression<E1, E2, T, Op>, T> {
+public:
+	MatrixBinaryExpression(const E1& first, const E2& second) : first(first), second(second) {
+		if (first.Height() != second.Height() || first.Width() != second.Width()) {
+			throw UnsuitableMatrixSizes("elementwise operations must take two matrices of the same length");
+		}
+	}
+
+	size_t Height() const {
+		return first.Height();
+	}
+	size_t Width() const {
+		return first.Width();
+	}
+
+	T Element(size_t k) const {
+		return Op()(first.Element(k), second.Element(k));
+	}
+
+	const E1& First() const {
+		return first;
+	}
+	const E2& Second() const {
+		return second;
+	}
+
+private:
+	MatrixOperand<E1> first;
+	MatrixOperand<E2> second;
+};
+
+template<typename E, typename T>
+class MatrixNegation : public MatrixExpression<MatrixNegation<E, T>, T> {
+public:
+	explicit MatrixNegation(const E& operand) : operand(operand) {}
+
+	size_t Height() const {
+		return operand.Height();
+	}
+	size_t Width() const {
+		return operand.Width();
+	}
+
+	T Element(size_t k) const {
+		return -operand.Element(k);
+	}
+
+private:
+	MatrixOperand<E> operand;
+};
+
+// ScalarFirst keeps the order of the factors for element types where it matters
+template<typename E, typename T, bool ScalarFirst>
+class MatrixScaled : public MatrixExpression<MatrixScaled<E, T, ScalarFirst>, T> {
+public:
+	MatrixScaled(const E& operand, T scalar) : operand(operand), scalar(std::move(scalar)) {}
+
+	size_t Height() const {
+		return operand.Height();
+	}
+	size_t Width() const {
+		return operand.Width();
+	}
+
+	T Element(size_t k) const {
+		if constexpr (ScalarFirst)
+			return scalar * operand.Element(k);
+		else
+			return operand.Element(k) * scalar;
+	}
+
+private:
+	MatrixOperand<E> operand;
+	T scalar;
+};
+
+template<typename E1, typename E2, typename T>
+MatrixBinaryExpression<E1, E2, T, std::plus<T>> operator+(const MatrixExpression<E1, T>& first, const MatrixExpression<E2, T>& second) {
+	return MatrixBinaryExpression<E1, E2, T, std::plus<T>>(first.Self(), second.Self());
+}
+template<typename E1, typename E2, typename T>
+MatrixBinaryExpression<E1, E2, T, std::minus<T>> operator-(const MatrixExpression<E1, T>& first, const MatrixExpression<E2, T>& second) {
+	return MatrixBinaryExpression<E1, E2, T, std::minus<T>>(first.Self(), second.Self());
+}
+template<typename E, typename T>
+MatrixNegation<E, T> operator-(const MatrixExpression<E, T>& operand) {
+	return MatrixNegation<E, T>(operand.Self());
+}
+template<typename E, typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+MatrixScaled<E, T, false> operator*(const MatrixExpression<E, T>& first, const T2& second) {
+	return MatrixScaled<E, T, false>(first.Self(), static_cast<T>(second));
+}
+template<typename E, typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+MatrixScaled<E, T, true> operator*(const T2& first, const MatrixExpression<E, T>& second) {
+	return MatrixScaled<E, T, true>(second.Self(), static_cast<T>(first));
+}
+
+template<typename E, typename T>
+std::ostream& operator<<(std::ostream& out, const MatrixExpression<E, T>& expression) {
+	return out << Matrix<T>(expression);
+}
+
+template<typename T>
+class Matrix : public MatrixExpression<Matrix<T>, T> {
 public:
-	Matrix(): data() {}
-	Matrix(size_t height, size_t width) : data(height, std::vector<T>(width)) {};
-	Matrix(size_t height, size_t width, T value) : data(height, std::vector<T>(width, value)) {};
-	explicit Matrix(std::vector<std::vector<T>> data): data(data) {};
+	Matrix(): data(), height(0), width(0) {}
+	Matrix(size_t height, size_t width) : data(height * width), height(height), width(width) {};
+	Matrix(size_t height, size_t width, T value) : data(height * width, value), height(height), width(width) {};
+	explicit Matrix(const std::vector<std::vector<T>>& rows) : data(), height(rows.size()), width(rows.empty() ? 0 : rows.front().size()) {
+		data.reserve(height * width);
+		for (const auto& i : rows) {
+			if (i.size() != width) {
+				throw UnsuitableMatrixSizes("all rows of a matrix must have the same length");
+			}
+			data.insert(data.end(), i.begin(), i.end());
+		}
+	};
 	template<typename T2>
-	Matrix(const Matrix<T2>& second): data(second.Height(), second.Width()) {
-		for (size_t i = 0; i < second.Height(); ++i) {
-			for (size_t j = 0; j < second.Width(); ++j) {
-				data[i][j] = static_cast<T2>(second.data[i][j]);
+	Matrix(const Matrix<T2>& second): data(second.Height() * second.Width()), height(second.Height()), width(second.Width()) {
+		for (size_t i = 0; i < height; ++i) {
+			for (size_t j = 0; j < width; ++j) {
+				(*this)[i][j] = static_cast<T>(second[i][j]);
 			}
 		}
 	}
 
+	template<typename Expr>
+	Matrix(const MatrixExpression<Expr, T>& expression) : data(), height(expression.Self().Height()), width(expression.Self().Width()) {
+		data.resize(height * width);
+		Evaluate(expression.Self());
+	}
+
+	template<typename Expr>
+	Matrix& operator=(const MatrixExpression<Expr, T>& expression) {
+		const Expr& e = expression.Self();
+		if (e.Height() != height || e.Width() != width) {
+			return *this = Matrix(expression);
+		}
+
+		// Every node reads only the element it writes, so evaluating over an operand is safe
+		Evaluate(e);
+		return *this;
+	}
+
 	static Matrix E(size_t height, size_t width) {
 		Matrix result(height, width);
 		for (size_t i = 0; i < height && i < width; ++i) {
@@ -47,96 +308,140 @@ public:
 		return result;
 	}
 
-	operator std::vector<std::vector<T>>& () {
-		return data;
-	};
-	operator const std::vector<std::vector<T>>&() const {
-		return data;
+	explicit operator std::vector<std::vector<T>>() const {
+		std::vector<std::vector<T>> result;
+		result.reserve(height);
+		for (const auto& i : *this) {
+			result.emplace_back(i.begin(), i.end());
+		}
+
+		return result;
 	};
-	std::vector<std::vector<T>>& GetData() {
+
+	// Row-major buffer of Height() * Width() elements, row i starts at i * Width()
+	std::vector<T>& GetData() {
 		return data;
 	}
-	const std::vector<std::vector<T>>& GetData() const {
+	const std::vector<T>& GetData() const {
 		return data;
 	}
 
 	size_t Height() const {
-		return data.size();
+		return height;
 	}
 	size_t Width() const {
-		return (Height() ? data.front().size() : 0);
+		return width;
+	}
+
+	// Keeps the top left corner, new elements are value-initialized
+	Matrix& Resize(size_t newHeight, size_t newWidth) {
+		if (newWidth == width) {
+			data.resize(newHeight * newWidth);
+		}
+		else {
+			std::vector<T> result(newHeight * newWidth);
+			for (size_t i = 0; i < std::min(height, newHeight); ++i) {
+				std::move(data.begin() + i * width, data.begin() + i * width + std::min(width, newWidth), result.begin() + i * newWidth);
+			}
+			data = std::move(result);
+		}
+		height = newHeight;
+		width = newWidth;
+
+		return *this;
+	}
+
+	void SwapRows(size_t i1, size_t i2) {
+		if (i1 != i2) {
+			swap((*this)[i1], (*this)[i2]);
+		}
 	}
 
-	typename std::vector<std::vector<T>>::iterator begin() {
-		return data.begin();
+	MatrixRowIterator<T> begin() {
+		return MatrixRowIterator<T>(data.data(), width, 0);
 	}
-	typename std::vector<std::vector<T>>::const_iterator begin() const {
-		return data.begin();
+	MatrixRowIterator<const T> begin() const {
+		return MatrixRowIterator<const T>(data.data(), width, 0);
 	}
-	typename std::vector<std::vector<T>>::iterator end() {
-		return data.end();
+	MatrixRowIterator<T> end() {
+		return MatrixRowIterator<T>(data.data(), width, height);
 	}
-	typename std::vector<std::vector<T>>::const_iterator end() const {
-		return data.end();
+	MatrixRowIterator<const T> end() const {
+		return MatrixRowIterator<const T>(data.data(), width, height);
 	}
 
-	std::vector<T>& operator[](size_t i) {
-		return data[i];
+	const T& Element(size_t k) const {
+		return data[k];
 	}
-	const std::vector<T>& operator[](size_t i) const {
-		return data[i];
+
+	MatrixRow<T> operator[](size_t i) {
+		return MatrixRow<T>(data.data() + i * width, width);
+	}
+	MatrixRow<const T> operator[](size_t i) const {
+		return MatrixRow<const T>(data.data() + i * width, width);
 	}
 
 	friend bool operator==(const Matrix& first, const Matrix& second) {
-		return first.GetData() == second.GetData();
+		return first.Height() == second.Height() && first.Width() == second.Width() && first.GetData() == second.GetData();
 	}
 	friend bool operator!=(const Matrix& first, const Matrix& second) {
-		return first.GetData() != second.GetData();
+		return !(first == second);
 	}
 
 	Matrix operator+() const {
 		return *this;
 	}
-	Matrix operator-() const {
-		Matrix result = *this;
-		for (auto& i : result) {
-			for (auto& j : i) {
-				j = -j;
-			}
-		}
-
-		return result;
+	// Temporaries give their storage to the result
+	friend Matrix operator+(Matrix&& first, Matrix&& second) {
+		first += second;
+		return std::move(first);
 	}
-
-	friend Matrix operator+(const Matrix& first, const Matrix& second) {
-		if (first.Height() != second.Height() || first.Width() != second.Width()) {
-			throw UnsuitableMatrixSizes("operator+ must take two matrices of the same length");
-		}
-
-		Matrix result(first.Height(), first.Width());
-		for (size_t i = 0; i < first.Height(); ++i) {
-			for (size_t j = 0; j < first.Width(); ++j) {
-				result[i][j] = first[i][j] + second[i][j];
-			}
-		}
-
-		return result;
+	template<typename Expr>
+	friend Matrix operator+(Matrix&& first, const MatrixExpression<Expr, T>& second) {
+		first += second;
+		return std::move(first);
+	}
+	template<typename Expr>
+	friend Matrix operator+(const MatrixExpression<Expr, T>& first, Matrix&& second) {
+		second += first;
+		return std::move(second);
+	}
+	friend Matrix operator-(Matrix&& first, Matrix&& second) {
+		first -= second;
+		return std::move(first);
+	}
+	template<typename Expr>
+	friend Matrix operator-(Matrix&& first, const MatrixExpression<Expr, T>& second) {
+		first -= second;
+		return std::move(first);
 	}
-	friend Matrix operator-(const Matrix& first, const Matrix& second) {
-		return first + (-second);
+	template<typename Expr>
+	friend Matrix operator-(const MatrixExpression<Expr, T>& first, Matrix&& second) {
+		const Expr& e = first.Self();
+		second.CheckSameSizes(e, "operator- must take two matrices of the same length");
+		second.Apply([&](size_t k, T& x) { x = e.Element(k) - x; });
+		return std::move(second);
 	}
+	friend Matrix operator-(Matrix&& operand) {
+		operand.Apply([](size_t, T& x) { x = -x; });
+		return std::move(operand);
+	}
+	// Only scalars: other matrix kinds with their own products must not be taken for one
+	template<typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2> && std::is_constructible<T, const T2&>::value>>
+	friend Matrix operator*(Matrix&& first, const T2& second) {
+		first *= second;
+		return std::move(first);
+	}
+	template<typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2> && std::is_constructible<T, const T2&>::value>>
+	friend Matrix operator*(const T2& first, Matrix&& second) {
+		const T scalar = static_cast<T>(first);
+		second.Apply([&](size_t, T& x) { x = scalar * x; });
+		return std::move(second);
+	}
+
 	friend Matrix operator*(const Matrix& first, const Matrix& second) {
-		if (first.Width() != second.Height()) {
-			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
-		}
-		Matrix result(first.Height(), second.Width());
-		for (size_t i = 0; i < first.Height(); ++i) {
-			for (size_t j = 0; j < second.Width(); ++j) {
-				for (size_t k = 0; k < first.Width(); ++k) {
-					result[i][j] += first[i][k] * second[k][j];
-				}
-			}
-		}
+		Matrix result;
+		Multiply(first, second, result);
 
 		return result;
 	}
@@ -145,46 +450,85 @@ public:
 			throw UnsuitableMatrixSizes("operator^ must take squere matrix");
 		}
 
-		if (second < 0) return (first ^ (-second)).Inverse();
+		// Inverting first keeps the entries of the intermediate powers small
+		if (second < 0) {
+			Matrix inverse = first;
+			return PowerUnsigned(inverse.Inverse(), Magnitude(second));
+		}
 
-		Matrix result = E(first.Height(), first.Width());
-		int i = 0;
-		for (Matrix curr = first; 0 < (second >> i); curr *= curr, ++i) {
-			if ((second >> i) & 1) {
-				result *= curr;
-			}
+		return PowerUnsigned(first, Magnitude(second));
+	}
+
+	// result = first * second. The buffer of result is reused when it is large enough, so it must not be one of the operands.
+	static void Multiply(const Matrix& first, const Matrix& second, Matrix& result) {
+		if (first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
 		}
 
-		return result;
+		result.data.assign(first.Height() * second.Width(), T{});
+		result.height = first.Height();
+		result.width = second.Width();
+		Gemm(first.Height(), second.Width(), first.Width(),
+			first.data.data(), first.width, second.data.data(), second.width, result.data.data(), result.width);
 	}
 
-	Matrix& operator+=(const Matrix& second) {
-		return *this = *this + second;
+	template<typename Expr>
+	Matrix& operator+=(const MatrixExpression<Expr, T>& second) {
+		const Expr& e = second.Self();
+		CheckSameSizes(e, "operator+= must take two matrices of the same length");
+		if constexpr (HasSimdKernels<T> && std::is_same<Expr, Matrix>::value) {
+			ApplyRange([&](size_t lo, size_t hi) { SimdAdd(hi - lo, data.data() + lo, e.data.data() + lo, data.data() + lo); });
+		}
+		else {
+			Apply([&](size_t k, T& x) { x += e.Element(k); });
+		}
+		return *this;
 	}
-	Matrix& operator-=(const Matrix& second) {
-		return *this = *this - second;
+	template<typename Expr>
+	Matrix& operator-=(const MatrixExpression<Expr, T>& second) {
+		const Expr& e = second.Self();
+		CheckSameSizes(e, "operator-= must take two matrices of the same length");
+		if constexpr (HasSimdKernels<T> && std::is_same<Expr, Matrix>::value) {
+			ApplyRange([&](size_t lo, size_t hi) { SimdSubtract(hi - lo, data.data() + lo, e.data.data() + lo, data.data() + lo); });
+		}
+		else {
+			Apply([&](size_t k, T& x) { x -= e.Element(k); });
+		}
+		return *this;
+	}
+	template<typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+	Matrix& operator*=(const T2& second) {
+		const T scalar = static_cast<T>(second);
+		Apply([&](size_t, T& x) { x *= scalar; });
+		return *this;
 	}
 	Matrix& operator*=(const Matrix& second) {
-		return *this = *this * second;
+		Matrix result;
+		Multiply(*this, second, result);
+		return *this = std::move(result);
 	}
 	Matrix& operator^=(long long second) {
 		return *this = ((*this) ^ second);
 	}
 
 	Matrix& Transpose() {
+		// Blocked, so that both the reads and the writes stay within a few cache lines
+		const size_t block = 32;
 		Matrix<T> res(Width(), Height());
-		for (int i = 0; i < Height(); ++i)
-			for (int j = 0; j < Width(); ++j)
-				res[j][i] = (*this)[i][j];
+		for (size_t i0 = 0; i0 < Height(); i0 += block)
+			for (size_t j0 = 0; j0 < Width(); j0 += block)
+				for (size_t i = i0; i < std::min(i0 + block, Height()); ++i)
+					for (size_t j = j0; j < std::min(j0 + block, Width()); ++j)
+						res.data[j * res.width + i] = std::move(data[i * width + j]);
 
-		return *this = res;
+		return *this = std::move(res);
 	}
 
 	Matrix& ToLadderForm() {
 		for (int i = 0, j = 0; i < Height() && j < Width(); ++j) {
 			for (int i1 = i; i1 < Height(); ++i1) {
 				if ((*this)[i1][j] != 0) {
-					swap((*this)[i], (*this)[i1]);
+					SwapRows(i, i1);
 					break;
 				}
 			}
@@ -198,14 +542,121 @@ public:
 				k *= d;
 			}
 
-			for (int i1 = 0; i1 < Height(); ++i1) {
-				if (i1 == i) {
+			ParallelFor(0, Height(), RowGrain(), [&](size_t lo, size_t hi) {
+				for (size_t i1 = lo; i1 < hi; ++i1) {
+					if (i1 == i) {
+						continue;
+					}
+
+					const T d = -(*this)[i1][j];
+					if (d != 0) {
+						Axpy(Width(), d, (*this)[i].begin(), (*this)[i1].begin());
+					}
+				}
+			});
+			++i;
+		}
+
+		return *this;
+	}
+
+	// Fraction-free Gauss-Jordan: each step is a Bareiss update (p * row - a * pivot row) / previous p, and every
+	// such division is exact, so integer entries stay integers no larger than the minors of the matrix.
+	// The result is d times the reduced row echelon form, d being the last pivot. Rows of a matrix of fractions
+	// are first scaled to integers, which does not change the row space. Rows are moved stably (abcd -> dabc)
+	// and rowOrder, if given, receives the original index of every row.
+	Matrix& ToFractionFreeForm(std::vector<size_t>* rowOrder = nullptr) {
+		if constexpr (HasDenominator<T>::value) {
+			ClearDenominators();
+		}
+		if (rowOrder) {
+			rowOrder->resize(Height());
+			for (size_t i = 0; i < Height(); ++i) {
+				(*rowOrder)[i] = i;
+			}
+		}
+
+		T previous{ 1 };
+		for (size_t i = 0, j = 0; i < Height() && j < Width(); ++j) {
+			size_t i1 = i;
+			while (i1 < Height() && (*this)[i1][j] == 0) {
+				++i1;
+			}
+			if (i1 == Height()) {
+				continue;
+			}
+			if (i1 != i) {
+				std::rotate(data.begin() + i * width, data.begin() + i1 * width, data.begin() + (i1 + 1) * width);
+				if (rowOrder) {
+					std::rotate(rowOrder->begin() + i, rowOrder->begin() + i1, rowOrder->begin() + i1 + 1);
+				}
+			}
+
+			const T pivot = (*this)[i][j];
+			ParallelFor(0, Height(), RowGrain(), [&](size_t lo, size_t hi) {
+				for (size_t i1 = lo; i1 < hi; ++i1) {
+					if (i1 == i) {
+						continue;
+					}
+
+					const T f = (*this)[i1][j];
+					for (size_t j1 = 0; j1 < Width(); ++j1) {
+						(*this)[i1][j1] = (pivot * (*this)[i1][j1] - f * (*this)[i][j1]) / previous;
+					}
+				}
+			});
+			previous = pivot;
+			++i;
+		}
+
+		return *this;
+	}
+
+	// Row Hermite normal form by unimodular row operations: positive pivots, entries above a pivot
+	// reduced into [0, pivot). Rows span the same integer lattice as before.
+	Matrix& ToHermiteForm() {
+		static_assert(std::is_integral<T>::value, "ToHermiteForm needs an integer element type");
+
+		for (size_t i = 0, j = 0; i < Height() && j < Width(); ++j) {
+			for (size_t i1 = i + 1; i1 < Height(); ++i1) {
+				if ((*this)[i1][j] == 0) {
 					continue;
 				}
 
-				T d = (*this)[i1][j];
-				for (int j1 = 0; j1 < Width(); ++j1) {
-					(*this)[i1][j1] -= d * (*this)[i][j1];
+				// x a + y b = g, the 2 x 2 transform [[x, y], [b / g, -a / g]] has determinant -1
+				T a = (*this)[i][j], b = (*this)[i1][j], x = 1, y = 0, x1 = 0, y1 = 1;
+				for (T r0 = a, r1 = b; r1 != 0;) {
+					const T q = r0 / r1;
+					r0 = std::exchange(r1, r0 - q * r1);
+					x = std::exchange(x1, x - q * x1);
+					y = std::exchange(y1, y - q * y1);
+				}
+				const T g = x * a + y * b;
+				const T u = b / g, v = a / g;
+				for (size_t j1 = j; j1 < Width(); ++j1) {
+					const T first = (*this)[i][j1], second = (*this)[i1][j1];
+					(*this)[i][j1] = x * first + y * second;
+					(*this)[i1][j1] = u * first - v * second;
+				}
+			}
+
+			if ((*this)[i][j] == 0) {
+				continue;
+			}
+			if ((*this)[i][j] < 0) {
+				for (auto& x : (*this)[i]) {
+					x = -x;
+				}
+			}
+
+			const T pivot = (*this)[i][j];
+			for (size_t i1 = 0; i1 < i; ++i1) {
+				T q = (*this)[i1][j] / pivot;
+				if ((*this)[i1][j] - q * pivot < 0) {
+					--q;
+				}
+				if (q != 0) {
+					Axpy(Width() - j, T{ -q }, (*this)[i].begin() + j, (*this)[i1].begin() + j);
 				}
 			}
 			++i;
@@ -224,8 +675,8 @@ public:
 		for (int i = 0, j = 0; i < Height() && j < Width(); ++j) {
 			for (int i1 = i; i1 < Height(); ++i1) {
 				if (help[i1][j] != 0) {
-					swap(help[i], help[i1]);
-					swap((*this)[i], (*this)[i1]);
+					help.SwapRows(i, i1);
+					SwapRows(i, i1);
 					break;
 				}
 			}
@@ -242,227 +693,821 @@ public:
 				k *= d;
 			}
 
-			for (int i1 = 0; i1 < Height(); ++i1) {
-				if (i1 == i) {
-					continue;
-				}
+			ParallelFor(0, Height(), RowGrain(), [&](size_t lo, size_t hi) {
+				for (size_t i1 = lo; i1 < hi; ++i1) {
+					if (i1 == i) {
+						continue;
+					}
 
-				T d = help[i1][j];
-				for (int j1 = 0; j1 < Width(); ++j1) {
-					help[i1][j1] -= d * help[i][j1];
-					(*this)[i1][j1] -= d * (*this)[i][j1];
+					const T d = -help[i1][j];
+					if (d != 0) {
+						Axpy(Width(), d, help[i].begin(), help[i1].begin());
+						Axpy(Width(), d, (*this)[i].begin(), (*this)[i1].begin());
+					}
 				}
-			}
+			});
 			++i;
 		}
 
 		if (help != E(Height(), Width()))
 		{
-			throw std::exception("Degenerate matrix");
+			throw std::domain_error("Degenerate matrix");
 		}
 
 		return *this;
 	}
 
-	Poly<T> CharacteristicPoly()
+	// det(tI - A)
+	Poly<T> CharacteristicPoly() const
 	{
 		if (Width() != Height()) {
 			throw UnsuitableMatrixSizes("CharacteristicPoly must take squere matrix");
 		}
-		Poly<T> result{};
 
-		Permutation c(Width());
-		do
-		{
-			Poly<T> current{c.Sgn()};
-			for (size_t i = 0; i < Width(); ++i)
-				current *= Poly<T>(std::vector<T>{ T{-data[i][c[i]]}, T{int(i == c[i])}});
-			result += current;
-		} while (c.Next());
+		if constexpr (IsField<T>)
+			return Poly<T>(CharacteristicHessenberg());
+		else
+			return Poly<T>(CharacteristicBerkowitz());
+	}
 
-		return result;
+	// det(tI - A) from its values at t = 0..n, n + 1 independent determinants computed in parallel and
+	// interpolated. O(n^4) work against O(n^3) of CharacteristicPoly, but every core gets its own elimination.
+	// For ModInt the modulus must exceed n, so that the points are distinct.
+	Poly<T> CharacteristicPolyInterpolated() const
+	{
+		static_assert(IsField<T>, "CharacteristicPolyInterpolated needs division");
+		if (Width() != Height()) {
+			throw UnsuitableMatrixSizes("CharacteristicPolyInterpolated must take squere matrix");
+		}
+
+		const size_t n = Width();
+		std::vector<T> points(n + 1), values(n + 1);
+		ParallelFor(0, n + 1, 1, [&](size_t lo, size_t hi) {
+			for (size_t k = lo; k < hi; ++k) {
+				points[k] = T(static_cast<long long>(k));
+				Matrix shifted = -(*this);
+				for (size_t i = 0; i < n; ++i) {
+					shifted[i][i] += points[k];
+				}
+				values[k] = shifted.Det();
+			}
+		});
+
+		return Poly<T>::Interpolate(points, values);
+	}
+
+	// x^k mod det(tI - A), so that A^k = r(A) by Cayley-Hamilton. O(n^2 log k) after the characteristic polynomial.
+	Poly<T> PowerRemainder(long long k) const
+	{
+		if (k < 0) {
+			throw std::domain_error("PowerRemainder must take a non-negative exponent");
+		}
+
+		return PowerRemainderUnsigned(Magnitude(k));
+	}
+
+	// A^k through PowerRemainder, the remainder is evaluated at A with about 2 sqrt(n) products (Paterson-Stockmeyer)
+	// instead of the 2 log k products of operator^. Pays off when k is much larger than n.
+	Matrix PowerCayleyHamilton(long long k) const
+	{
+		if (k < 0) {
+			Matrix inverse = *this;
+			return inverse.Inverse().PowerCayleyHamiltonUnsigned(Magnitude(k));
+		}
+
+		return PowerCayleyHamiltonUnsigned(Magnitude(k));
+	}
+
+	// A^k * v without forming A^k: the Krylov vectors v, Av, ..., A^{n-1}v are combined with the
+	// coefficients of PowerRemainder. v may have several columns.
+	Matrix PowerTimes(long long k, const Matrix& v) const
+	{
+		if (k < 0) {
+			Matrix inverse = *this;
+			return inverse.Inverse().PowerTimesUnsigned(Magnitude(k), v);
+		}
+
+		return PowerTimesUnsigned(Magnitude(k), v);
 	}
 
-	/*
-	T Det()
+	T Det() const
 	{
 		if (Width() != Height()) {
 			throw UnsuitableMatrixSizes("Det must take squere matrix");
 		}
-		return (Width() % 2 ? -1 : +1) * CharacteristicPoly()(T{ 0 });
+
+		if constexpr (std::is_integral<T>::value)
+			return DetBareiss();
+		else if constexpr (IsField<T>)
+			return DetGauss();
+		else {
+			T result = CharacteristicBerkowitz().front();
+			return (Width() % 2 ? -result : result);
+		}
+	}
+
+	// Reads "height width" and the elements, see MatrixTextReader. Malformed input sets failbit and leaves m
+	// as it was; when in.exceptions() includes failbit, TextParseError with the line and column of the offending
+	// token is thrown.
+	friend std::istream& operator>>(std::istream& in, Matrix& m) {
+		try {
+			MatrixTextReader<T> reader(in);
+			Matrix result(reader.Height(), reader.Width());
+			for (size_t i = 0; i < result.Height(); ++i) {
+				reader.NextRow(result.data.data() + i * result.Width());
+			}
+
+			m = std::move(result);
+		}
+		catch (const TextParseError&) {
+			if (in.exceptions() & std::ios_base::failbit) {
+				throw;
+			}
+		}
+
+		return in;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const Matrix& m) {
+		WriteMatrixTable(out, m);
+		return out;
+	}
+
+private:
+	std::vector<T> data;
+	size_t height, width;
+
+	// |k| without overflow, LLONG_MIN included
+	static unsigned long long Magnitude(long long k) {
+		return (k < 0 ? 0 - static_cast<unsigned long long>(k) : static_cast<unsigned long long>(k));
+	}
+
+	// Binary powering. Three buffers for the whole loop: the products are written into scratch and swapped in
+	static Matrix PowerUnsigned(const Matrix& base, unsigned long long k) {
+		Matrix result = E(base.Height(), base.Width()), curr = base, scratch;
+		for (; k > 0; k >>= 1) {
+			if (k & 1) {
+				Multiply(result, curr, scratch);
+				std::swap(result, scratch);
+			}
+			if (k > 1) {
+				Multiply(curr, curr, scratch);
+				std::swap(curr, scratch);
+			}
+		}
+
+		return result;
 	}
-	*/
 
-	T Det()
+	Poly<T> PowerRemainderUnsigned(unsigned long long k) const
 	{
-		T result{ 0 };
-		Permutation c(Width());
-		do
-		{
-			T current{ c.Sgn() };
-			for (size_t i = 0; i < Width(); ++i)
-				current *= data[i][c[i]];
-			result = result + current;
-		} while (c.Next());
+		if (Width() != Height()) {
+			throw UnsuitableMatrixSizes("PowerRemainder must take squere matrix");
+		}
+
+		const Poly<T> modulus = CharacteristicPoly();
+		Poly<T> result = Poly<T>(T{ 1 }).Remainder(modulus), base = Poly<T>(std::vector<T>{ T{ 0 }, T{ 1 } }).Remainder(modulus);
+		for (; k > 0; k >>= 1) {
+			if (k & 1) {
+				result = (result * base).Remainder(modulus);
+			}
+			if (k > 1) {
+				base = (base * base).Remainder(modulus);
+			}
+		}
 
 		return result;
 	}
 
-	friend std::ifstream& operator>>(std::istream& in, Matrix& m) {
-		size_t n, m;
-		in >> n >> m;
-		m = std::vector<std::vector<T>>(n, m);
-		for (auto& i : m) {
-			for (auto& j : i) {
-				in >> j;
+	Matrix PowerCayleyHamiltonUnsigned(unsigned long long k) const
+	{
+		const Poly<T> r = PowerRemainderUnsigned(k);
+		const size_t n = Width();
+		size_t s = 1;
+		while (s * s < n) {
+			++s;
+		}
+
+		// powers[i] = A^i for i <= s
+		std::vector<Matrix> powers(s + 1);
+		powers[0] = E(n, n);
+		for (size_t i = 1; i <= s; ++i) {
+			Multiply(powers[i - 1], *this, powers[i]);
+		}
+
+		// r(x) = sum_j q_j(x) (x^s)^j with deg q_j < s, evaluated by Horner in x^s
+		Matrix result(n, n), scratch;
+		for (size_t j = (n + s - 1) / s; j-- > 0;) {
+			if (j + 1 < (n + s - 1) / s) {
+				Multiply(result, powers[s], scratch);
+				std::swap(result, scratch);
+			}
+			for (size_t i = 0; i < s && j * s + i < n; ++i) {
+				const T c = r[j * s + i];
+				if (c != 0) {
+					result += c * powers[i];
+				}
 			}
 		}
 
-		return in;
+		return result;
 	}
 
-	friend std::ostream& operator<<(std::ostream& out, const Matrix& m) {
-		std::vector<size_t> colum_len(m.Width());
-		for (size_t j = 0; j < m.Width(); ++j) {
-			for (const auto& i : m) {
-				std::ostringstream curr;
-				curr << i[j];
-				colum_len[j] = std::max(colum_len[j], 
-					curr.str().size());
+	Matrix PowerTimesUnsigned(unsigned long long k, const Matrix& v) const
+	{
+		if (Height() != v.Height()) {
+			throw UnsuitableMatrixSizes("PowerTimes must take a matrix and vectors of the same height");
+		}
+
+		const Poly<T> r = PowerRemainderUnsigned(k);
+		Matrix result(v.Height(), v.Width()), krylov = v, scratch;
+		for (size_t i = 0; i < Width(); ++i) {
+			const T c = r[i];
+			if (c != 0) {
+				result += c * krylov;
+			}
+			if (i + 1 < Width()) {
+				Multiply(*this, krylov, scratch);
+				std::swap(krylov, scratch);
+			}
+		}
+
+		return result;
+	}
+
+	// Smallest amount of elements worth handing to another thread
+	static constexpr size_t ParallelGrain = 1 << 14;
+
+	template<typename Expr>
+	void Evaluate(const Expr& expression) {
+		if constexpr (HasSimdKernels<T> && std::is_same<Expr, MatrixBinaryExpression<Matrix, Matrix, T, std::plus<T>>>::value) {
+			ApplyRange([&](size_t lo, size_t hi) {
+				SimdAdd(hi - lo, expression.First().data.data() + lo, expression.Second().data.data() + lo, data.data() + lo);
+			});
+		}
+		else if constexpr (HasSimdKernels<T> && std::is_same<Expr, MatrixBinaryExpression<Matrix, Matrix, T, std::minus<T>>>::value) {
+			ApplyRange([&](size_t lo, size_t hi) {
+				SimdSubtract(hi - lo, expression.First().data.data() + lo, expression.Second().data.data() + lo, data.data() + lo);
+			});
+		}
+		else {
+			Apply([&](size_t k, T& x) { x = expression.Element(k); });
+		}
+	}
+
+	// Calls f(lo, hi) on parallel chunks of the element range
+	template<typename F>
+	void ApplyRange(F f) {
+		ParallelFor(0, data.size(), ParallelGrain, f);
+	}
+
+	// Calls f(k, data[k]) for every element
+	template<typename F>
+	void Apply(F f) {
+		ParallelFor(0, data.size(), ParallelGrain, [&](size_t lo, size_t hi) {
+			for (size_t k = lo; k < hi; ++k) {
+				f(k, data[k]);
 			}
+		});
+	}
+
+	template<typename Expr>
+	void CheckSameSizes(const Expr& second, const char* whatStr) const {
+		if (Height() != second.Height() || Width() != second.Width()) {
+			throw UnsuitableMatrixSizes(whatStr);
 		}
+	}
+
+	size_t RowGrain() const {
+		return std::max<size_t>(1, ParallelGrain / std::max<size_t>(Width(), 1));
+	}
 
-		for (size_t i = 0; i < m.Height(); ++i) {
-			out << "|";
-			for (size_t j = 0; j < m.Width(); ++j) {
-				out << std::setw(colum_len[j] + (j != 0)) << m[i][j];
+	// Multiplies every row by the least common multiple of its denominators
+	void ClearDenominators() {
+		for (auto& row : *this) {
+			auto multiple = T{ 1 }.Denominator();
+			for (const auto& x : row) {
+				const auto d = x.Denominator();
+				multiple = multiple / Gcd(multiple, d) * d;
 			}
-			out << "|";
-			if (i + 1 < m.Height()) {
-				out << '\n';
+
+			const T f = multiple;
+			if (f != 1) {
+				for (auto& x : row) {
+					x *= f;
+				}
 			}
 		}
+	}
 
-		return out;
+	// Gaussian elimination, for fields. Floating point types pick the largest pivot, exact types the first nonzero one.
+	T DetGauss() const
+	{
+		Matrix help = *this;
+		T result{ 1 };
+		for (size_t j = 0; j < Width(); ++j) {
+			size_t pivot = j;
+			for (size_t i1 = j; i1 < Height(); ++i1) {
+				if constexpr (std::is_floating_point<T>::value) {
+					if (std::abs(help[i1][j]) > std::abs(help[pivot][j]))
+						pivot = i1;
+				}
+				else if (help[i1][j] != 0) {
+					pivot = i1;
+					break;
+				}
+			}
+
+			if (help[pivot][j] == 0) {
+				return T{ 0 };
+			}
+			if (pivot != j) {
+				help.SwapRows(pivot, j);
+				result = -result;
+			}
+			result *= help[j][j];
+
+			T d = 1 / help[j][j];
+			ParallelFor(j + 1, Height(), RowGrain(), [&](size_t lo, size_t hi) {
+				for (size_t i1 = lo; i1 < hi; ++i1) {
+					const T f = -(help[i1][j] * d);
+					Axpy(Width() - j - 1, f, help[j].begin() + j + 1, help[i1].begin() + j + 1);
+				}
+			});
+		}
+
+		return result;
 	}
 
-private:
-	std::vector<std::vector<T>> data;
+	// Fraction-free Bareiss elimination, every division is exact so integer types never round
+	T DetBareiss() const
+	{
+		Matrix help = *this;
+		T previous{ 1 };
+		bool negate = false;
+		for (size_t j = 0; j < Width(); ++j) {
+			if (help[j][j] == 0) {
+				size_t i1 = j + 1;
+				while (i1 < Height() && help[i1][j] == 0)
+					++i1;
+
+				if (i1 == Height()) {
+					return T{ 0 };
+				}
+				help.SwapRows(i1, j);
+				negate = !negate;
+			}
+
+			ParallelFor(j + 1, Height(), RowGrain(), [&](size_t lo, size_t hi) {
+				for (size_t i1 = lo; i1 < hi; ++i1) {
+					for (size_t j1 = j + 1; j1 < Width(); ++j1) {
+						help[i1][j1] = (help[i1][j1] * help[j][j] - help[i1][j] * help[j][j1]) / previous;
+					}
+				}
+			});
+			previous = help[j][j];
+		}
+
+		T result = (Width() ? help[Width() - 1][Width() - 1] : T{ 1 });
+		return (negate ? -result : result);
+	}
+
+	// Coefficients of det(tI - A) from the lowest one, O(n^3) for fields.
+	// A is brought to the upper Hessenberg form by similarity transforms, then the leading minors follow a recurrence.
+	std::vector<T> CharacteristicHessenberg() const
+	{
+		const size_t n = Width();
+		Matrix h = *this;
+		for (size_t j = 0; j + 2 < n; ++j) {
+			size_t pivot = j + 1;
+			for (size_t i1 = j + 1; i1 < n; ++i1) {
+				if constexpr (std::is_floating_point<T>::value) {
+					if (std::abs(h[i1][j]) > std::abs(h[pivot][j]))
+						pivot = i1;
+				}
+				else if (h[i1][j] != 0) {
+					pivot = i1;
+					break;
+				}
+			}
+
+			if (h[pivot][j] == 0) {
+				continue;
+			}
+			if (pivot != j + 1) {
+				h.SwapRows(pivot, j + 1);
+				for (size_t i1 = 0; i1 < n; ++i1) {
+					std::swap(h[i1][pivot], h[i1][j + 1]);
+				}
+			}
+
+			T d = 1 / h[j + 1][j];
+			for (size_t i1 = j + 2; i1 < n; ++i1) {
+				T u = h[i1][j] * d;
+				if (u == 0) {
+					continue;
+				}
+				for (size_t j1 = j; j1 < n; ++j1) {
+					h[i1][j1] -= u * h[j + 1][j1];
+				}
+				for (size_t i2 = 0; i2 < n; ++i2) {
+					h[i2][j + 1] += u * h[i2][i1];
+				}
+			}
+		}
+
+		// p[m] is the characteristic polynomial of the leading m x m block
+		std::vector<std::vector<T>> p(n + 1);
+		p[0] = { T{ 1 } };
+		for (size_t m = 1; m <= n; ++m) {
+			p[m].assign(m + 1, T{ 0 });
+			for (size_t k = 0; k < m; ++k) {
+				p[m][k + 1] += p[m - 1][k];
+				p[m][k] -= h[m - 1][m - 1] * p[m - 1][k];
+			}
+
+			T subdiagonal{ 1 };
+			for (size_t i = 1; i < m; ++i) {
+				subdiagonal *= h[m - i][m - i - 1];
+				if (subdiagonal == 0) {
+					break;
+				}
+				T f = subdiagonal * h[m - i - 1][m - 1];
+				for (size_t k = 0; k < p[m - i - 1].size(); ++k) {
+					p[m][k] -= f * p[m - i - 1][k];
+				}
+			}
+		}
+
+		return p[n];
+	}
+
+	// Coefficients of det(tI - A) from the lowest one, O(n^4) without any division, so it works over any commutative ring.
+	// Berkowitz: the leading k x k block is [[B, c], [r, a]], and
+	// p_k(t) = (t - a) p_{k-1}(t) - sum_{j >= 1} (r B^{j-1} c) sum_{m >= j} p_{k-1}[m] t^{m-j}
+	std::vector<T> CharacteristicBerkowitz() const
+	{
+		const size_t n = Width();
+		std::vector<T> p = { T{ 1 } };
+		std::vector<T> column, next;
+		for (size_t k = 1; k <= n; ++k) {
+			const size_t m = k - 1;
+			std::vector<T> result(k + 1, T{ 0 });
+			for (size_t i = 0; i <= m; ++i) {
+				result[i + 1] += p[i];
+				result[i] -= (*this)[m][m] * p[i];
+			}
+
+			column.assign(m, T{ 0 });
+			for (size_t i = 0; i < m; ++i) {
+				column[i] = (*this)[i][m];
+			}
+			for (size_t j = 1; j <= m; ++j) {
+				T f{ 0 };
+				for (size_t i = 0; i < m; ++i) {
+					f += (*this)[m][i] * column[i];
+				}
+				for (size_t i = j; i <= m; ++i) {
+					result[i - j] -= f * p[i];
+				}
+
+				if (j < m) {
+					next.assign(m, T{ 0 });
+					for (size_t i = 0; i < m; ++i) {
+						for (size_t i1 = 0; i1 < m; ++i1) {
+							next[i] += (*this)[i][i1] * column[i1];
+						}
+					}
+					std::swap(column, next);
+				}
+			}
+			p = std::move(result);
+		}
+
+		return p;
+	}
+
+	template<typename T2>
+	friend class Matrix;
 };
 
+// value * E of whatever size the other operand has. A + 1, A - k and A == 0 touch only the diagonal of A
+// instead of building a full matrix, products just scale.
 template<typename T>
-class DynamicMatrix {
+class ScalarMatrix {
 public:
-	DynamicMatrix() : get([](size_t, size_t) -> T { return {}; }) {}
-	explicit DynamicMatrix(std::function<T(size_t, size_t)> get): get(get) {}
-	explicit DynamicMatrix(T value) : get([=](size_t i, size_t j) -> T { return (i == j ? value : T{}); }) {}
+	ScalarMatrix() : value() {}
+	explicit ScalarMatrix(T value) : value(std::move(value)) {}
+
+	static ScalarMatrix Identity() {
+		return ScalarMatrix(T{ 1 });
+	}
+
+	const T& Value() const {
+		return value;
+	}
+
+	T operator()(size_t i, size_t j) const {
+		return (i == j ? value : T{});
+	}
 
 	Matrix<T> FixSizes(size_t height, size_t width) const {
 		Matrix<T> result(height, width);
-		for (size_t i = 0; i < height; ++i) {
-			for (size_t j = 0; j < width; ++j) {
-				result[i][j] = get(i, j);
+		for (size_t i = 0; i < std::min(height, width); ++i) {
+			result[i][i] = value;
+		}
+
+		return result;
+	}
+
+	ScalarMatrix operator+() const {
+		return *this;
+	}
+	ScalarMatrix operator-() const {
+		return ScalarMatrix(-value);
+	}
+
+	friend ScalarMatrix operator+(const ScalarMatrix& first, const ScalarMatrix& second) {
+		return ScalarMatrix(first.value + second.value);
+	}
+	friend ScalarMatrix operator-(const ScalarMatrix& first, const ScalarMatrix& second) {
+		return ScalarMatrix(first.value - second.value);
+	}
+	friend ScalarMatrix operator*(const ScalarMatrix& first, const ScalarMatrix& second) {
+		return ScalarMatrix(first.value * second.value);
+	}
+
+	// In pair with Matrix
+public:
+	friend bool operator==(const Matrix<T>& first, const ScalarMatrix& second) {
+		for (size_t i = 0; i < first.Height(); ++i) {
+			for (size_t j = 0; j < first.Width(); ++j) {
+				if (!(first[i][j] == second(i, j))) {
+					return false;
+				}
 			}
 		}
 
+		return true;
+	}
+	friend bool operator==(const ScalarMatrix& first, const Matrix<T>& second) {
+		return second == first;
+	}
+	friend bool operator!=(const Matrix<T>& first, const ScalarMatrix& second) {
+		return !(first == second);
+	}
+	friend bool operator!=(const ScalarMatrix& first, const Matrix<T>& second) {
+		return !(second == first);
+	}
+
+	friend Matrix<T> operator+(Matrix<T> first, const ScalarMatrix& second) {
+		second.AddToDiagonal(first);
+		return first;
+	}
+	friend Matrix<T> operator+(const ScalarMatrix& first, Matrix<T> second) {
+		first.AddToDiagonal(second);
+		return second;
+	}
+	friend Matrix<T> operator-(Matrix<T> first, const ScalarMatrix& second) {
+		(-second).AddToDiagonal(first);
+		return first;
+	}
+	friend Matrix<T> operator-(const ScalarMatrix& first, Matrix<T> second) {
+		second = -std::move(second);
+		first.AddToDiagonal(second);
+		return second;
+	}
+	friend Matrix<T> operator*(Matrix<T> first, const ScalarMatrix& second) {
+		return std::move(first) * second.value;
+	}
+	friend Matrix<T> operator*(const ScalarMatrix& first, Matrix<T> second) {
+		return first.value * std::move(second);
+	}
+
+private:
+	T value;
+
+	void AddToDiagonal(Matrix<T>& m) const {
+		for (size_t i = 0; i < std::min(m.Height(), m.Width()); ++i) {
+			m[i][i] += value;
+		}
+	}
+};
+
+template<typename T, typename F = std::function<T(size_t, size_t)>>
+class DynamicMatrix;
+
+template<typename T, typename F>
+DynamicMatrix<T, std::decay_t<F>> MakeDynamicMatrix(F&& get);
+
+// A matrix of any size given by a callable get(i, j). The callable keeps its own type, so calls are inlined
+// and +, - and scaling compose statically instead of nesting std::function calls. Build one with
+// MakeDynamicMatrix<T>(get). The default F keeps the type-erased form for code that needs one type for
+// all generators. get is called from several threads at once and must not modify shared state.
+template<typename T, typename F>
+class DynamicMatrix {
+public:
+	DynamicMatrix() : get([](size_t, size_t) -> T { return {}; }) {}
+	explicit DynamicMatrix(F get) : get(std::move(get)) {}
+	explicit DynamicMatrix(T value) : get([=](size_t i, size_t j) -> T { return (i == j ? value : T{}); }) {}
+
+	T operator()(size_t i, size_t j) const {
+		return get(i, j);
+	}
+
+	const F& Generator() const {
+		return get;
+	}
+
+	Matrix<T> FixSizes(size_t height, size_t width) const {
+		Matrix<T> result(height, width);
+		Generate(0, height, 0, width, result.GetData().data(), width);
 		return result;
 	}
 
+	// Writes rows [rowBegin, rowEnd) and columns [columnBegin, columnEnd) to out, ld elements per row. Tiles of
+	// Block x Block are filled in parallel, so generators that read another matrix by columns stay in cache.
+	void Generate(size_t rowBegin, size_t rowEnd, size_t columnBegin, size_t columnEnd, T* out, size_t ld) const {
+		const size_t tiles = (rowEnd - rowBegin + Block - 1) / Block;
+		const size_t grain = std::max<size_t>(1, (1 << 14) / std::max<size_t>(Block * (columnEnd - columnBegin), 1));
+		ParallelFor(0, tiles, grain, [&](size_t lo, size_t hi) {
+			for (size_t tile = lo; tile < hi; ++tile) {
+				const size_t i0 = rowBegin + tile * Block, i1 = std::min(rowEnd, i0 + Block);
+				for (size_t j0 = columnBegin; j0 < columnEnd; j0 += Block) {
+					const size_t j1 = std::min(columnEnd, j0 + Block);
+					for (size_t i = i0; i < i1; ++i) {
+						T* row = out + (i - rowBegin) * ld - columnBegin;
+						for (size_t j = j0; j < j1; ++j) {
+							row[j] = get(i, j);
+						}
+					}
+				}
+			}
+		});
+	}
+
 	DynamicMatrix operator+() const {
 		return *this;
 	}
-	DynamicMatrix operator-() const {
-		return DynamicMatrix([=](size_t i, size_t j) {
-			return -(this->get(i, j));
-		});	
+	auto operator-() const {
+		return MakeDynamicMatrix<T>([get = get](size_t i, size_t j) -> T {
+			return -get(i, j);
+		});
 	}
 
-	friend DynamicMatrix operator+(const DynamicMatrix& first, const DynamicMatrix& second) {
-		return DynamicMatrix([first, second](size_t i, size_t j) { 
-			return first.get(i, j) + second.get(i, j); 
+	template<typename F2>
+	friend auto operator+(const DynamicMatrix& first, const DynamicMatrix<T, F2>& second) {
+		return MakeDynamicMatrix<T>([first = first.get, second = second.Generator()](size_t i, size_t j) -> T {
+			return first(i, j) + second(i, j);
 		});
 	}
-	friend DynamicMatrix operator-(const DynamicMatrix& first, const DynamicMatrix& second) {
-		return first + (-second);
+	template<typename F2>
+	friend auto operator-(const DynamicMatrix& first, const DynamicMatrix<T, F2>& second) {
+		return MakeDynamicMatrix<T>([first = first.get, second = second.Generator()](size_t i, size_t j) -> T {
+			return first(i, j) - second(i, j);
+		});
 	}
 
 	// In pair with Matrix
 public:
 	friend bool operator==(const Matrix<T>& first, const DynamicMatrix& second) {
-		return first == second.FixSizes(first.Height(), first.Width());
+		for (size_t i = 0; i < first.Height(); ++i) {
+			for (size_t j = 0; j < first.Width(); ++j) {
+				if (!(first[i][j] == second.get(i, j))) {
+					return false;
+				}
+			}
+		}
+
+		return true;
 	}
-	friend bool operator==(const  DynamicMatrix& first, const Matrix<T>& second) {
-		return first.FixSizes(second.Height(), second.Width()) == second;
+	friend bool operator==(const DynamicMatrix& first, const Matrix<T>& second) {
+		return second == first;
 	}
 	friend bool operator!=(const Matrix<T>& first, const DynamicMatrix& second) {
-		return first == second.FixSizes(first.Height(), first.Width());
+		return !(first == second);
 	}
-	friend bool operator!=(const  DynamicMatrix& first, const Matrix<T>& second) {
-		return first.FixSizes(second.Height(), second.Width()) != second;
+	friend bool operator!=(const DynamicMatrix& first, const Matrix<T>& second) {
+		return !(second == first);
 	}
 
-	friend Matrix<T> operator+(const Matrix<T>& first, const DynamicMatrix& second) {
-		return first + second.FixSizes(first.Height(), first.Width());
+	friend Matrix<T> operator+(Matrix<T> first, const DynamicMatrix& second) {
+		second.Combine(first, [](T& x, T y) { x += y; });
+		return first;
 	}
-	friend Matrix<T> operator+(const DynamicMatrix& first, const Matrix<T>& second) {
-		return first.FixSizes(second.Height(), second.Width()) + second;
+	friend Matrix<T> operator+(const DynamicMatrix& first, Matrix<T> second) {
+		first.Combine(second, [](T& x, T y) { x = y + x; });
+		return second;
 	}
-	friend Matrix<T> operator-(const Matrix<T>& first, const DynamicMatrix& second) {
-		return first - second.FixSizes(first.Height(), first.Width());
+	friend Matrix<T> operator-(Matrix<T> first, const DynamicMatrix& second) {
+		second.Combine(first, [](T& x, T y) { x -= y; });
+		return first;
 	}
-	friend Matrix<T> operator-(const DynamicMatrix& first, const Matrix<T>& second) {
-		return first.FixSizes(second.Height(), second.Width()) - second;
+	friend Matrix<T> operator-(const DynamicMatrix& first, Matrix<T> second) {
+		first.Combine(second, [](T& x, T y) { x = y - x; });
+		return second;
 	}
+
+	// Panels of Panel rows of second are generated one at a time and multiplied right away, so the
+	// Width() x Width() operand never exists in full
 	friend Matrix<T> operator*(const Matrix<T>& first, const DynamicMatrix& second) {
-		return first * second.FixSizes(first.Width(), first.Width());
+		const size_t n = first.Width();
+		Matrix<T> result(first.Height(), n);
+		std::vector<T> panel;
+		for (size_t k0 = 0; k0 < n; k0 += Panel) {
+			const size_t kc = std::min(Panel, n - k0);
+			panel.resize(kc * n);
+			second.Generate(k0, k0 + kc, 0, n, panel.data(), n);
+			Gemm(first.Height(), n, kc, first.GetData().data() + k0, n, panel.data(), n, result.GetData().data(), n);
+		}
+
+		return result;
 	}
+	// Same with panels of Panel columns of first
 	friend Matrix<T> operator*(const DynamicMatrix& first, const Matrix<T>& second) {
-		return first.FixSizes(second.Height(), second.Height()) * second;
+		const size_t n = second.Height(), m = second.Width();
+		Matrix<T> result(n, m);
+		std::vector<T> panel;
+		for (size_t k0 = 0; k0 < n; k0 += Panel) {
+			const size_t kc = std::min(Panel, n - k0);
+			panel.resize(n * kc);
+			first.Generate(0, n, k0, k0 + kc, panel.data(), kc);
+			Gemm(n, m, kc, panel.data(), kc, second.GetData().data() + k0 * m, m, result.GetData().data(), m);
+		}
+
+		return result;
 	}
 
 private:
-	std::function<T(size_t, size_t)> get;
+	F get;
+
+	static constexpr size_t Block = 64;
+	static constexpr size_t Panel = 256;
+
+	// op(m[i][j], get(i, j)) for every element, rows in parallel
+	template<typename Op>
+	void Combine(Matrix<T>& m, Op op) const {
+		const size_t width = m.Width();
+		ParallelFor(0, m.Height(), std::max<size_t>(1, (1 << 14) / std::max<size_t>(width, 1)), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				T* row = m.GetData().data() + i * width;
+				for (size_t j = 0; j < width; ++j) {
+					op(row[j], get(i, j));
+				}
+			}
+		});
+	}
 };
 
-template<typename T, typename T2>
+template<typename T, typename F>
+DynamicMatrix<T, std::decay_t<F>> MakeDynamicMatrix(F&& get) {
+	return DynamicMatrix<T, std::decay_t<F>>(std::forward<F>(get));
+}
+
+template<typename T, typename F, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+auto operator*(const DynamicMatrix<T, F>& first, const T2& second) {
+	return MakeDynamicMatrix<T>([get = first.Generator(), scalar = static_cast<T>(second)](size_t i, size_t j) -> T {
+		return get(i, j) * scalar;
+	});
+}
+template<typename T, typename F, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+auto operator*(const T2& first, const DynamicMatrix<T, F>& second) {
+	return MakeDynamicMatrix<T>([get = second.Generator(), scalar = static_cast<T>(first)](size_t i, size_t j) -> T {
+		return scalar * get(i, j);
+	});
+}
+
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
 bool operator==(const Matrix<T>& first, const T2& second) {
-	return first == static_cast<DynamicMatrix<T>>(static_cast<T>(second)).FixSizes(first.Height(), first.Width());
+	return first == ScalarMatrix<T>(static_cast<T>(second));
 }
-template<typename T, typename T2>
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
 bool operator==(const T2& first, const Matrix<T>& second) {
-	return static_cast<DynamicMatrix<T>>(static_cast<T>(first)).FixSizes(second.Height(), second.Width()) == second;
+	return ScalarMatrix<T>(static_cast<T>(first)) == second;
 }
-template<typename T, typename T2>
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
 bool operator!=(const Matrix<T>& first, const T2& second) {
-	return first != static_cast<DynamicMatrix<T>>(static_cast<T>(second)).FixSizes(first.Height(), first.Width());
+	return first != ScalarMatrix<T>(static_cast<T>(second));
 }
-template<typename T, typename T2>
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
 bool operator!=(const T2& first, const Matrix<T>& second) {
-	return static_cast<DynamicMatrix<T>>(static_cast<T>(first)).FixSizes(second.Height(), second.Width()) != second;
+	return ScalarMatrix<T>(static_cast<T>(first)) != second;
 }
 
 
-template<typename T, typename T2>
-Matrix<T> operator+(const Matrix<T>& first, const T2& second) {
-	return first + static_cast<DynamicMatrix<T>>(static_cast<T>(second)).FixSizes(first.Height(), first.Width());
-}
-template<typename T, typename T2>
-Matrix<T> operator+(const T2& first, const Matrix<T>& second) {
-	return static_cast<DynamicMatrix<T>>(static_cast<T>(first)).FixSizes(second.Height(), second.Width()) + second;
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+Matrix<T> operator+(Matrix<T> first, const T2& second) {
+	return std::move(first) + ScalarMatrix<T>(static_cast<T>(second));
 }
-template<typename T, typename T2>
-Matrix<T> operator-(const Matrix<T>& first, const T2& second) {
-	return first - static_cast<DynamicMatrix<T>>(static_cast<T>(second)).FixSizes(first.Height(), first.Width());
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+Matrix<T> operator+(const T2& first, Matrix<T> second) {
+	return ScalarMatrix<T>(static_cast<T>(first)) + std::move(second);
 }
-template<typename T, typename T2>
-Matrix<T> operator-(const T2& first, const Matrix<T>& second) {
-	return static_cast<DynamicMatrix<T>>(static_cast<T>(first)).FixSizes(second.Height(), second.Width()) - second;
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+Matrix<T> operator-(Matrix<T> first, const T2& second) {
+	return std::move(first) - ScalarMatrix<T>(static_cast<T>(second));
 }
-template<typename T, typename T2>
-Matrix<T> operator*(const Matrix<T>& first, const T2& second) {
-	return first * static_cast<DynamicMatrix<T>>(static_cast<T>(second)).FixSizes(first.Width(), first.Width());
+template<typename T, typename T2, typename = std::enable_if_t<!IsMatrixExpression<T2>>>
+Matrix<T> operator-(const T2& first, Matrix<T> second) {
+	return ScalarMatrix<T>(static_cast<T>(first)) - std::move(second);
 }
-template<typename T, typename T2>
-Matrix<T> operator*(const T2& first, const Matrix<T>& second) {
-	return static_cast<DynamicMatrix<T>>(static_cast<T>(first)).FixSizes(second.Height(), second.Height()) * second;
-}
\ No newline at end of file
@@ -0,0 +1,306 @@
+#pragma once
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Many matrices of the same size stored interleaved: items are grouped by Lanes, and inside a group
+// element (i, j) of all items is contiguous, so every elimination step runs as one vector loop across
+// the items. Groups are independent and fit in cache, they are what the threads share out.
+// Singular items do not throw, Inverse and Solve report them with a nonzero flag per item instead. Inverse and
+// Solve need a field, Det also takes integers.
+template<typename T>
+class MatrixBatch {
+public:
+	static constexpr size_t Lanes = std::max<size_t>(1, 64 / sizeof(T));
+
+	MatrixBatch(size_t count, size_t height, size_t width)
+		: data((count + Lanes - 1) / Lanes * height * width * Lanes), count(count), height(height), width(width) {}
+
+	size_t Count() const {
+		return count;
+	}
+	size_t Height() const {
+		return height;
+	}
+	size_t Width() const {
+		return width;
+	}
+
+	T& operator()(size_t item, size_t i, size_t j) {
+		return data[Index(item, i, j)];
+	}
+	const T& operator()(size_t item, size_t i, size_t j) const {
+		return data[Index(item, i, j)];
+	}
+
+	Matrix<T> Get(size_t item) const {
+		Matrix<T> result(height, width);
+		for (size_t i = 0; i < height; ++i)
+			for (size_t j = 0; j < width; ++j)
+				result[i][j] = (*this)(item, i, j);
+
+		return result;
+	}
+	void Set(size_t item, const Matrix<T>& m) {
+		if (m.Height() != height || m.Width() != width) {
+			throw UnsuitableMatrixSizes("Set must take a matrix with the sizes of the batch");
+		}
+
+		for (size_t i = 0; i < height; ++i)
+			for (size_t j = 0; j < width; ++j)
+				(*this)(item, i, j) = m[i][j];
+	}
+
+	friend MatrixBatch operator*(const MatrixBatch& first, const MatrixBatch& second) {
+		if (first.Count() != second.Count() || first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two batches of the same count such that the width of the first matrices is equal to the height of the second");
+		}
+
+		MatrixBatch result(first.Count(), first.Height(), second.Width());
+		const size_t m = first.Height(), n = second.Width(), k = first.Width();
+		first.ForGroups(m * n * k, [&](size_t g, T*) {
+			const T* a = first.Group(g);
+			const T* b = second.Group(g);
+			T* c = result.Group(g);
+			for (size_t i = 0; i < m; ++i)
+				for (size_t p = 0; p < k; ++p)
+					for (size_t j = 0; j < n; ++j)
+						for (size_t l = 0; l < Lanes; ++l)
+							c[(i * n + j) * Lanes + l] += a[(i * k + p) * Lanes + l] * b[(p * n + j) * Lanes + l];
+		});
+
+		return result;
+	}
+
+	// Gaussian elimination over a field, fraction-free (Bareiss) for integers
+	std::vector<T> Det() const {
+		static_assert(IsField<T> || std::is_integral<T>::value, "Det needs an element type with division or an integer type");
+		CheckSquare("Det must take batch of squere matrices");
+
+		std::vector<T> result(count);
+		ForGroups(height * height * height, [&](size_t g, T* help) {
+			std::copy(Group(g), Group(g) + GroupSize(), help);
+			T det[Lanes];
+			if constexpr (std::is_integral<T>::value)
+				DetBareiss(help, det);
+			else
+				DetGauss(help, det);
+
+			for (size_t l = 0; l < Lanes && g * Lanes + l < count; ++l)
+				result[g * Lanes + l] = det[l];
+		});
+
+		return result;
+	}
+
+	// Inverts every item in place, an item flagged as singular is left in an unspecified state
+	std::vector<char> Inverse() {
+		static_assert(IsField<T>, "Inverse needs an element type with division");
+		CheckSquare("Inverse must take batch of squere matrices");
+
+		std::vector<char> singular(count, 0);
+		ForGroups(height * height * height, [&](size_t g, T* help) {
+			T* a = Group(g);
+			std::copy(a, a + GroupSize(), help);
+			std::fill(a, a + GroupSize(), T{ 0 });
+			for (size_t i = 0; i < height; ++i)
+				std::fill(a + (i * width + i) * Lanes, a + (i * width + i + 1) * Lanes, T{ 1 });
+
+			GaussJordan(help, a, width, g, singular);
+		});
+
+		return singular;
+	}
+
+	// Overwrites every item of rhs with the solution of A X = B, the items of this batch are the A
+	std::vector<char> Solve(MatrixBatch& rhs) const {
+		static_assert(IsField<T>, "Solve needs an element type with division");
+		CheckSquare("Solve must take batch of squere matrices");
+		if (rhs.Count() != count || rhs.Height() != height) {
+			throw UnsuitableMatrixSizes("Solve must take a batch of right-hand sides with the same count and height");
+		}
+
+		std::vector<char> singular(count, 0);
+		ForGroups(height * height * (height + rhs.Width()), [&](size_t g, T* help) {
+			std::copy(Group(g), Group(g) + GroupSize(), help);
+			GaussJordan(help, rhs.Group(g), rhs.Width(), g, singular);
+		});
+
+		return singular;
+	}
+
+private:
+	std::vector<T> data;
+	size_t count, height, width;
+
+	size_t GroupSize() const {
+		return height * width * Lanes;
+	}
+	size_t Index(size_t item, size_t i, size_t j) const {
+		return item / Lanes * GroupSize() + (i * width + j) * Lanes + item % Lanes;
+	}
+	T* Group(size_t g) {
+		return data.data() + g * GroupSize();
+	}
+	const T* Group(size_t g) const {
+		return data.data() + g * GroupSize();
+	}
+
+	void CheckSquare(const char* whatStr) const {
+		if (height != width) {
+			throw UnsuitableMatrixSizes(whatStr);
+		}
+	}
+
+	// Calls f(g, scratch) for every group, cost is the amount of work per item. The scratch buffer holds
+	// a group and is shared by the groups of one chunk.
+	template<typename F>
+	void ForGroups(size_t cost, F f) const {
+		const size_t grain = std::max<size_t>(1, (1 << 14) / std::max<size_t>(cost * Lanes, 1));
+		ParallelFor(0, (count + Lanes - 1) / Lanes, grain, [&](size_t lo, size_t hi) {
+			std::vector<T> scratch(GroupSize());
+			for (size_t g = lo; g < hi; ++g)
+				f(g, scratch.data());
+		});
+	}
+
+	// Row in [j, height) of lane l to eliminate column j with: the largest one for floating point, the first nonzero otherwise
+	size_t Pivot(const T* a, size_t l, size_t j) const {
+		size_t pivot = j;
+		for (size_t i1 = j; i1 < height; ++i1) {
+			const T& x = a[(i1 * width + j) * Lanes + l];
+			if constexpr (std::is_floating_point<T>::value) {
+				if (std::abs(x) > std::abs(a[(pivot * width + j) * Lanes + l]))
+					pivot = i1;
+			}
+			else if (x != 0) {
+				return i1;
+			}
+		}
+
+		return pivot;
+	}
+
+	static void SwapRows(T* a, size_t w, size_t l, size_t i1, size_t i2) {
+		for (size_t j = 0; j < w; ++j)
+			std::swap(a[(i1 * w + j) * Lanes + l], a[(i2 * w + j) * Lanes + l]);
+	}
+
+	// Row i1 -= (a[i1][j] * inverse) * row j on columns [from, w) of every lane
+	static void Eliminate(T* a, size_t w, const T* inverse, size_t j, size_t i1, size_t from) {
+		T f[Lanes];
+		for (size_t l = 0; l < Lanes; ++l)
+			f[l] = a[(i1 * w + j) * Lanes + l] * inverse[l];
+
+		for (size_t j1 = from; j1 < w; ++j1)
+			for (size_t l = 0; l < Lanes; ++l)
+				a[(i1 * w + j1) * Lanes + l] -= f[l] * a[(j * w + j1) * Lanes + l];
+	}
+
+	void DetGauss(T* a, T* det) const {
+		T inverse[Lanes];
+		std::fill(det, det + Lanes, T{ 1 });
+		for (size_t j = 0; j < height; ++j) {
+			for (size_t l = 0; l < Lanes; ++l) {
+				const size_t pivot = Pivot(a, l, j);
+				if (pivot != j) {
+					SwapRows(a, width, l, pivot, j);
+					det[l] = -det[l];
+				}
+
+				const T& x = a[(j * width + j) * Lanes + l];
+				det[l] *= x;
+				inverse[l] = (x != 0 ? 1 / x : T{ 0 });
+			}
+
+			for (size_t i1 = j + 1; i1 < height; ++i1)
+				Eliminate(a, width, inverse, j, i1, j + 1);
+		}
+	}
+
+	// Row i1 = (p * row i1 - a[i1][j] * row j) / previous p, every division is exact and the last pivot is the
+	// determinant up to the sign of the swaps. A lane without a pivot keeps a pivot of 1 so it never divides
+	// by zero, and its determinant is 0.
+	void DetBareiss(T* a, T* det) const {
+		T pivots[Lanes], previous[Lanes], f[Lanes];
+		bool zero[Lanes] = {};
+		std::fill(det, det + Lanes, T{ 1 });
+		std::fill(previous, previous + Lanes, T{ 1 });
+		for (size_t j = 0; j < height; ++j) {
+			for (size_t l = 0; l < Lanes; ++l) {
+				const size_t pivot = Pivot(a, l, j);
+				if (pivot != j) {
+					SwapRows(a, width, l, pivot, j);
+					det[l] = -det[l];
+				}
+
+				pivots[l] = a[(j * width + j) * Lanes + l];
+				zero[l] = zero[l] || pivots[l] == 0;
+				if (pivots[l] == 0)
+					pivots[l] = 1;
+			}
+
+			for (size_t i1 = j + 1; i1 < height; ++i1) {
+				for (size_t l = 0; l < Lanes; ++l)
+					f[l] = a[(i1 * width + j) * Lanes + l];
+				for (size_t j1 = j + 1; j1 < width; ++j1)
+					for (size_t l = 0; l < Lanes; ++l)
+						a[(i1 * width + j1) * Lanes + l] = (pivots[l] * a[(i1 * width + j1) * Lanes + l] - f[l] * a[(j * width + j1) * Lanes + l]) / previous[l];
+			}
+			std::copy(pivots, pivots + Lanes, previous);
+		}
+
+		for (size_t l = 0; l < Lanes; ++l)
+			det[l] = (zero[l] ? T{ 0 } : det[l] * previous[l]);
+	}
+
+	// Reduces a to the identity and applies the same row operations to x. A lane without a pivot gets a zero
+	// inverse, so its rows stop changing instead of dividing by zero, and is flagged.
+	void GaussJordan(T* a, T* x, size_t xWidth, size_t g, std::vector<char>& singular) const {
+		T inverse[Lanes], f[Lanes];
+		bool failed[Lanes] = {};
+		for (size_t j = 0; j < height; ++j) {
+			for (size_t l = 0; l < Lanes; ++l) {
+				const size_t pivot = Pivot(a, l, j);
+				if (pivot != j) {
+					SwapRows(a, width, l, pivot, j);
+					SwapRows(x, xWidth, l, pivot, j);
+				}
+
+				const T& p = a[(j * width + j) * Lanes + l];
+				failed[l] = failed[l] || p == 0;
+				inverse[l] = (p != 0 ? 1 / p : T{ 0 });
+			}
+
+			for (size_t j1 = j; j1 < width; ++j1)
+				for (size_t l = 0; l < Lanes; ++l)
+					a[(j * width + j1) * Lanes + l] *= inverse[l];
+			for (size_t j1 = 0; j1 < xWidth; ++j1)
+				for (size_t l = 0; l < Lanes; ++l)
+					x[(j * xWidth + j1) * Lanes + l] *= inverse[l];
+
+			for (size_t i1 = 0; i1 < height; ++i1) {
+				if (i1 == j)
+					continue;
+
+				for (size_t l = 0; l < Lanes; ++l)
+					f[l] = a[(i1 * width + j) * Lanes + l];
+				for (size_t j1 = j; j1 < width; ++j1)
+					for (size_t l = 0; l < Lanes; ++l)
+						a[(i1 * width + j1) * Lanes + l] -= f[l] * a[(j * width + j1) * Lanes + l];
+				for (size_t j1 = 0; j1 < xWidth; ++j1)
+					for (size_t l = 0; l < Lanes; ++l)
+						x[(i1 * xWidth + j1) * Lanes + l] -= f[l] * x[(j * xWidth + j1) * Lanes + l];
+			}
+		}
+
+		for (size_t l = 0; l < Lanes && g * Lanes + l < count; ++l)
+			singular[g * Lanes + l] = failed[l];
+	}
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstddef>
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Constants of Montgomery multiplication modulo an odd modulus below 2^63, with R = 2^64
+struct MontgomeryParameters {
+    uint64_t modulus;
+    uint64_t inverse; // modulus^-1 mod 2^64
+    uint64_t r2;      // R^2 mod modulus
+
+    constexpr explicit MontgomeryParameters(uint64_t modulus) : modulus(modulus), inverse(modulus), r2(0) {
+        if (modulus % 2 == 0 || modulus >> 63) {
+            throw std::domain_error("ModInt modulus must be odd and below 2^63");
+        }
+
+        // Newton's iteration doubles the number of correct low bits, modulus itself is right in 3 of them
+        for (int i = 0; i < 5; ++i) {
+            inverse *= 2 - modulus * inverse;
+        }
+
+        const unsigned __int128 r = (0 - modulus) % modulus;
+        r2 = static_cast<uint64_t>(r * r % modulus);
+    }
+
+    // t * R^-1 mod modulus for t < modulus * R
+    constexpr uint64_t Reduce(unsigned __int128 t) const {
+        const uint64_t m = static_cast<uint64_t>(t) * inverse;
+        const uint64_t high = static_cast<uint64_t>(t >> 64), correction = static_cast<uint64_t>((static_cast<unsigned __int128>(m) * modulus) >> 64);
+        return (high >= correction ? high - correction : high - correction + modulus);
+    }
+};
+
+// Element of Z / PZ kept in Montgomery form, so multiplication needs no division. P = 0 selects a runtime
+// modulus shared by all ModInt<0>, set it with SetModulus before use and not while other threads compute.
+// The modulus must be odd and below 2^63, and prime for division to be defined for every nonzero element.
+// Comparisons order the representatives in (-P/2, P/2], so that printing signs comes out naturally.
+template<uint64_t P>
+class ModInt {
+public:
+    ModInt() : value(0) {}
+
+    template<typename I, typename = std::enable_if_t<std::is_integral<I>::value>>
+    ModInt(I x) {
+        const uint64_t m = Modulus();
+        uint64_t residue;
+        if constexpr (std::is_signed<I>::value) {
+            long long r = static_cast<long long>(x) % static_cast<long long>(m);
+            residue = static_cast<uint64_t>(r < 0 ? r + static_cast<long long>(m) : r);
+        }
+        else {
+            residue = static_cast<uint64_t>(x) % m;
+        }
+
+        value = Parameters().Reduce(static_cast<unsigned __int128>(residue) * Parameters().r2);
+    }
+
+    static uint64_t Modulus() {
+        return Parameters().modulus;
+    }
+    static void SetModulus(uint64_t modulus) {
+        static_assert(P == 0, "SetModulus is only available for runtime moduli");
+        runtimeParameters = MontgomeryParameters(modulus);
+    }
+
+    // Canonical representative in [0, P)
+    uint64_t Value() const {
+        return Parameters().Reduce(value);
+    }
+
+    // Extended Euclid on the canonical representative, throws if the element is not invertible
+    ModInt Inverse() const {
+        long long r0 = static_cast<long long>(Modulus()), r1 = static_cast<long long>(Value()), s0 = 0, s1 = 1;
+        while (r1 != 0) {
+            const long long q = r0 / r1;
+            r0 -= q * r1;
+            std::swap(r0, r1);
+            s0 -= q * s1;
+            std::swap(s0, s1);
+        }
+        if (r0 != 1) {
+            throw std::domain_error("ModInt element is not invertible");
+        }
+
+        return ModInt(s0);
+    }
+
+    ModInt Pow(long long k) const {
+        ModInt result = 1, x = (k < 0 ? Inverse() : *this);
+        for (unsigned long long e = (k < 0 ? -static_cast<unsigned long long>(k) : k); e > 0; e >>= 1, x *= x) {
+            if (e & 1) {
+                result *= x;
+            }
+        }
+
+        return result;
+    }
+
+    ModInt operator+() const {
+        return *this;
+    }
+    ModInt operator-() const {
+        ModInt result;
+        result.value = (value == 0 ? 0 : Modulus() - value);
+        return result;
+    }
+
+    friend ModInt operator+(ModInt first, const ModInt& second) {
+        return first += second;
+    }
+    friend ModInt operator-(ModInt first, const ModInt& second) {
+        return first -= second;
+    }
+    friend ModInt operator*(ModInt first, const ModInt& second) {
+        return first *= second;
+    }
+    friend ModInt operator/(ModInt first, const ModInt& second) {
+        return first /= second;
+    }
+
+    ModInt& operator+=(const ModInt& second) {
+        value += second.value;
+        if (value >= Modulus()) {
+            value -= Modulus();
+        }
+        return *this;
+    }
+    ModInt& operator-=(const ModInt& second) {
+        value = (value >= second.value ? value - second.value : value - second.value + Modulus());
+        return *this;
+    }
+    ModInt& operator*=(const ModInt& second) {
+        value = Parameters().Reduce(static_cast<unsigned __int128>(value) * second.value);
+        return *this;
+    }
+    ModInt& operator/=(const ModInt& second) {
+        return *this *= second.Inverse();
+    }
+
+    friend bool operator==(const ModInt& first, const ModInt& second) {
+        return first.value == second.value;
+    }
+    friend bool operator!=(const ModInt& first, const ModInt& second) {
+        return first.value != second.value;
+    }
+    friend bool operator<(const ModInt& first, const ModInt& second) {
+        return first.Signed() < second.Signed();
+    }
+    friend bool operator<=(const ModInt& first, const ModInt& second) {
+        return first.Signed() <= second.Signed();
+    }
+    friend bool operator>(const ModInt& first, const ModInt& second) {
+        return first.Signed() > second.Signed();
+    }
+    friend bool operator>=(const ModInt& first, const ModInt& second) {
+        return first.Signed() >= second.Signed();
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const ModInt& x) {
+        return out << x.Value();
+    }
+
+    friend void AppendText(std::string& out, const ModInt& x) {
+        char digits[24];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), x.Value()).ptr);
+    }
+
+    template<uint64_t Q>
+    friend void GemmGeneric(size_t m, size_t n, size_t k, const ModInt<Q>* a, size_t lda, const ModInt<Q>* b, size_t ldb, ModInt<Q>* c, size_t ldc);
+
+private:
+    uint64_t value; // x * R mod P
+
+    static inline MontgomeryParameters runtimeParameters{ 1 };
+
+    static const MontgomeryParameters& Parameters() {
+        if constexpr (P != 0) {
+            static constexpr MontgomeryParameters parameters{ P };
+            return parameters;
+        }
+        else {
+            return runtimeParameters;
+        }
+    }
+
+    long long Signed() const {
+        const uint64_t x = Value();
+        return (x > Modulus() / 2 ? static_cast<long long>(x - Modulus()) : static_cast<long long>(x));
+    }
+};
+
+// Overload taken by GemmClassic: the products of a row of C are summed in 128 bits and reduced once at the end.
+// Keeping the sum below P * 2^64 by a conditional subtraction leaves its value mod P and its reduction unchanged.
+template<uint64_t Q>
+void GemmGeneric(size_t m, size_t n, size_t k, const ModInt<Q>* a, size_t lda, const ModInt<Q>* b, size_t ldb, ModInt<Q>* c, size_t ldc) {
+    const MontgomeryParameters& parameters = ModInt<Q>::Parameters();
+    const unsigned __int128 bound = static_cast<unsigned __int128>(parameters.modulus) << 64;
+
+    std::vector<unsigned __int128> sums(n);
+    for (size_t i = 0; i < m; ++i) {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (size_t p = 0; p < k; ++p) {
+            const uint64_t aip = a[i * lda + p].value;
+            if (aip == 0) {
+                continue;
+            }
+
+            const ModInt<Q>* bp = b + p * ldb;
+            for (size_t j = 0; j < n; ++j) {
+                sums[j] += static_cast<unsigned __int128>(aip) * bp[j].value;
+                if (sums[j] >= bound) {
+                    sums[j] -= bound;
+                }
+            }
+        }
+
+        ModInt<Q>* ci = c + i * ldc;
+        for (size_t j = 0; j < n; ++j) {
+            ModInt<Q> product;
+            product.value = parameters.Reduce(sums[j]);
+            ci[j] += product;
+        }
+    }
+}
@@ -84,7 +84,7 @@ int Permutation::Sgn() const
 
 bool Permutation::Next()
 {
-	if (size() <= 1) return true;
+	if (size() <= 1) return false;
 
 	int i;
 	for (i = size() - 2; i >= 0 && data[i] > data[i + 1]; --i);
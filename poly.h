@@ -1,38 +1,55 @@
 #pragma once
 
+#include "poly_eval.h"
+#include "poly_multiply.h"
+#include "thread_pool.h"
+#include "text_format.h"
+
 #include <cstdint>
 #include <algorithm>
 #include <vector>
-#include <unordered_map>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <utility>
 
+// Coefficients are kept in one of two forms. Dense: coefficients_[i] is the coefficient of t^i and the
+// last one is nonzero, so the degree is read off the size. Sparse: terms_ holds the nonzero
+// (degree, coefficient) pairs sorted by degree. The form follows the fill ratio after every operation,
+// so characteristic polynomials and recurrences stay contiguous while t^1000000 + 1 costs two terms.
 template<typename T>
 class Poly {
 public:
-    Poly() {
+    Poly() : sparse_(false) {
     }
 
-    Poly(T c) {
-        if (c != 0) {
-            coefficients_[0] = c;
+    Poly(T c) : sparse_(false) {
+        if (c != T{0}) {
+            coefficients_.push_back(std::move(c));
         }
     }
 
-    Poly(std::vector<T> coefficients) {
-        for (size_t i = 0; i < coefficients.size(); ++i) {
-            if (coefficients[i] != T{0}) {
-                coefficients_[i] = coefficients[i];
-            }
-        }
+    Poly(std::vector<T> coefficients) : coefficients_(std::move(coefficients)), sparse_(false) {
+        Normalize();
     }
 
-    Poly(std::vector<std::pair<int, T>> coefficients) {
-        for (const auto& [i, ai] : coefficients) {
-            if (ai) {
-                coefficients_[i] = ai;
+    // A later pair overrides an earlier one of the same degree
+    Poly(std::vector<std::pair<int, T>> coefficients) : sparse_(true) {
+        std::stable_sort(coefficients.begin(), coefficients.end(), [](const auto& first, const auto& second) {
+            return first.first < second.first;
+        });
+        for (size_t k = 0; k < coefficients.size(); ++k) {
+            if (k + 1 < coefficients.size() && coefficients[k + 1].first == coefficients[k].first) {
+                continue;
+            }
+            if (coefficients[k].first < 0) {
+                throw std::domain_error("Polynomial degrees must not be negative");
+            }
+            if (coefficients[k].second != T{0}) {
+                terms_.emplace_back(static_cast<size_t>(coefficients[k].first), std::move(coefficients[k].second));
             }
         }
+        Normalize();
     }
 
     Poly(const Poly& from) = default;
@@ -41,12 +58,24 @@ public:
     Poly& operator=(const Poly & from) = default;
     Poly& operator=(Poly && from) = default;
 
-    T operator()(T x) const {
-        T result = 0;
+    // Horner on the dense form. Sparse terms are walked from the top and the gap between neighbouring
+    // degrees is bridged with one power, so t^1000000 + 1 still costs O(log) products.
+    T operator()(const T& x) const {
+        if (!sparse_) {
+            if (coefficients_.empty()) {
+                return T{ 0 };
+            }
+
+            T result = coefficients_.back();
+            for (size_t i = coefficients_.size() - 1; i-- > 0;) {
+                result = result * x + coefficients_[i];
+            }
+            return result;
+        }
 
         const auto quick_power = [](T x, size_t k) -> T {
             T result = 1, pi = x;
-            for (size_t i = 0; (1 << i) <= k; ++i) {
+            for (size_t i = 0; (size_t{ 1 } << i) <= k; ++i) {
                 if (i != 0) {
                     pi *= pi;
                 }
@@ -58,19 +87,97 @@ public:
             return result;
         };
 
-        for (const auto& [i, ai] : coefficients_) {
-            result += ai * quick_power(x, i);
+        T result = 0;
+        for (size_t k = terms_.size(); k-- > 0;) {
+            const size_t below = (k > 0 ? terms_[k - 1].first : 0);
+            result = (result + terms_[k].second) * quick_power(x, terms_[k].first - below);
         }
 
         return result;
     }
 
+    // Values at every point. Exact fields with many points and a long polynomial go through a subproduct
+    // tree in O(d log^2 d), otherwise Horner runs on PolyEvaluationLanes points at a time.
+    std::vector<T> Evaluate(const std::vector<T>& points) const {
+        if (sparse_) {
+            std::vector<T> values(points.size());
+            const size_t grain = std::max<size_t>(1, (1 << 14) / (terms_.size() * 64));
+            ParallelFor(0, points.size(), grain, [&](size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; ++i) {
+                    values[i] = (*this)(points[i]);
+                }
+            });
+            return values;
+        }
+
+        if constexpr (HasExactDivision<T>::value) {
+            if (std::min(points.size(), coefficients_.size()) >= PolyMultipointThreshold) {
+                return SubproductTree<T>(points).Evaluate(coefficients_);
+            }
+        }
+        return PolyEvaluateHorner(coefficients_, points);
+    }
+
+    // The polynomial of degree below points.size() taking values[i] at points[i]. The points must be
+    // distinct. Subproduct tree in O(d log^2 d) for exact fields, Lagrange in O(d^2) otherwise.
+    static Poly Interpolate(const std::vector<T>& points, const std::vector<T>& values) {
+        if (points.size() != values.size()) {
+            throw std::invalid_argument("Interpolate must take one value per point");
+        }
+        if (points.empty()) {
+            return Poly();
+        }
+
+        if constexpr (HasExactDivision<T>::value) {
+            if (points.size() >= PolyMultipointThreshold) {
+                return Poly(SubproductTree<T>(points).Interpolate(values));
+            }
+        }
+
+        // M(t) = prod (t - x_j), then M(t) / (t - x_i) by synthetic division for every point
+        std::vector<T> product{ T{ 1 } };
+        for (const T& x : points) {
+            product.insert(product.begin(), T{ 0 });
+            for (size_t j = 0; j + 1 < product.size(); ++j) {
+                product[j] -= x * product[j + 1];
+            }
+        }
+
+        std::vector<T> result(points.size(), T{ 0 }), quotient(points.size());
+        for (size_t i = 0; i < points.size(); ++i) {
+            T carry{ 0 };
+            for (size_t j = points.size(); j-- > 0;) {
+                carry = product[j + 1] + carry * points[i];
+                quotient[j] = carry;
+            }
+
+            // The quotient at x_i is M'(x_i), the product of x_i - x_j over the other points
+            T weight = quotient.back();
+            for (size_t j = points.size() - 1; j-- > 0;) {
+                weight = weight * points[i] + quotient[j];
+            }
+            if (weight == T{ 0 }) {
+                throw std::domain_error("Interpolation points must be distinct");
+            }
+
+            const T scale = values[i] / weight;
+            for (size_t j = 0; j < points.size(); ++j) {
+                result[j] += scale * quotient[j];
+            }
+        }
+
+        return Poly(result);
+    }
+
     bool operator==(const Poly& second) const {
-        return coefficients_ == second.coefficients_;
+        if (!sparse_ && !second.sparse_) {
+            return coefficients_ == second.coefficients_;
+        }
+        return Terms() == second.Terms();
     }
 
     bool operator!=(const Poly& second) const {
-        return coefficients_ != second.coefficients_;
+        return !(*this == second);
     }
 
     Poly operator+() const {
@@ -78,132 +185,327 @@ public:
     }
 
     Poly operator-() const {
-        Poly result;
-        result.coefficients_ = coefficients_;
-        for (auto& [i, ai] : result.coefficients_) {
+        Poly result = *this;
+        for (auto& ai : result.coefficients_) {
+            ai = -ai;
+        }
+        for (auto& [i, ai] : result.terms_) {
             ai = -ai;
         }
         return result;
     }
 
     Poly operator+(const Poly& second) const {
-        Poly result;
-        result.coefficients_ = coefficients_;
-        for (const auto& [i, ai] : second.coefficients_) {
-            result.coefficients_[i] += ai;
-            if (result.coefficients_[i] == T{ 0 }) {
-                result.coefficients_.erase(i);
-            }
-        }
-
-        return result;
+        Poly result = *this;
+        return result += second;
     }
 
     Poly operator-(const Poly& second) const {
-        Poly result;
-        result.coefficients_ = coefficients_;
-        for (const auto& [i, ai] : second.coefficients_) {
-            result.coefficients_[i] -= ai;
-            if (result.coefficients_[i] == T{ 0 }) {
-                result.coefficients_.erase(i);
-            }
-        }
-
-        return result;
+        Poly result = *this;
+        return result -= second;
     }
 
     Poly& operator+=(const Poly& second) {
-        for (const auto& [i, ai] : second.coefficients_) {
-            coefficients_[i] += ai;
-            if (coefficients_[i] == T{ 0 }) {
-                coefficients_.erase(i);
-            }
-        }
-
+        Combine(second, [](T& x, const T& y) { x += y; });
         return *this;
     }
 
     Poly& operator-=(const Poly& second) {
-        for (const auto& [i, ai] : second.coefficients_) {
-            coefficients_[i] -= ai;
-            if (coefficients_[i] == T{ 0 }) {
-                coefficients_.erase(i);
-            }
-        }
-
+        Combine(second, [](T& x, const T& y) { x -= y; });
         return *this;
     }
 
+    // Dense operands go through PolyMultiply. With a sparse one, term products are accumulated into a
+    // vector when the result is dense enough and sorted and merged otherwise.
     Poly operator*(const Poly& second) const {
+        if (IsZero() || second.IsZero()) {
+            return Poly();
+        }
+
         Poly result;
+        if (!sparse_ && !second.sparse_) {
+            result.coefficients_ = PolyMultiply(coefficients_, second.coefficients_);
+            result.Normalize();
+            return result;
+        }
 
-        for (const auto& [i, ai] : coefficients_) {
-            for (const auto& [j, bj] : second.coefficients_) {
-                result.coefficients_[i + j] += ai * bj;
-                if (result.coefficients_[i] == T{ 0 }) {
-                    result.coefficients_.erase(i);
+        const std::vector<std::pair<size_t, T>> first_terms = Terms(), second_terms = second.Terms();
+        const size_t degree = static_cast<size_t>(Degree() + second.Degree());
+        if (degree < DenseFill * first_terms.size() * second_terms.size()) {
+            result.coefficients_.assign(degree + 1, T{0});
+            for (const auto& [i, ai] : first_terms) {
+                for (const auto& [j, bj] : second_terms) {
+                    result.coefficients_[i + j] += ai * bj;
                 }
             }
         }
+        else {
+            result.sparse_ = true;
+            result.terms_.reserve(first_terms.size() * second_terms.size());
+            for (const auto& [i, ai] : first_terms) {
+                for (const auto& [j, bj] : second_terms) {
+                    result.terms_.emplace_back(i + j, ai * bj);
+                }
+            }
+            std::sort(result.terms_.begin(), result.terms_.end(), [](const auto& first, const auto& second) {
+                return first.first < second.first;
+            });
+            result.MergeTerms();
+        }
+        result.Normalize();
 
         return result;
     }
 
+    // Short dense factors are multiplied into the storage of this from the highest degree down, each
+    // coefficient is overwritten only after every product that reads it
     Poly& operator*=(const Poly& second) {
-        return *this = (*this) * second;
+        if (sparse_ || second.sparse_ || IsZero() || second.IsZero() || this == &second) {
+            return *this = (*this) * second;
+        }
+        if (std::min(coefficients_.size(), second.coefficients_.size()) >= PolyKaratsubaThreshold) {
+            coefficients_ = PolyMultiply(coefficients_, second.coefficients_);
+            Normalize();
+            return *this;
+        }
+
+        const size_t n = coefficients_.size(), m = second.coefficients_.size();
+        coefficients_.resize(n + m - 1, T{0});
+        for (size_t k = n + m - 1; k-- > 0;) {
+            T sum{0};
+            for (size_t j = (k + 1 > n ? k + 1 - n : 0); j <= std::min(k, m - 1); ++j) {
+                sum += coefficients_[k - j] * second.coefficients_[j];
+            }
+            coefficients_[k] = std::move(sum);
+        }
+        Normalize();
+
+        return *this;
     }
 
+    // Only the degrees are sorted, every coefficient is formatted once straight into one buffer
     friend std::ostream& operator<<(std::ostream& out, const Poly& poly) {
-        if (poly.coefficients_.empty()) {
+        if (poly.IsZero()) {
             return out << "0";
         }
 
-        std::vector<std::pair<size_t, T>> sorted_coefficients;
-        for (const auto& coefficient : poly.coefficients_) {
-            sorted_coefficients.push_back(coefficient);
-        }
-        std::sort(sorted_coefficients.begin(), sorted_coefficients.end(), std::greater<std::pair<size_t, T>>());
-
-        std::ostringstream tout;
-        for (const auto& [i, ai] : sorted_coefficients) {
-            if (i != sorted_coefficients.front().first) {
-                if (ai > 0) {
-                    tout << "+";
-                }
-                else {
-                    tout << "-";
-                }
+        const std::vector<std::pair<size_t, T>> terms = poly.Terms();
+        std::string text;
+        for (auto it = terms.rbegin(); it != terms.rend(); ++it) {
+            const auto& [i, ai] = *it;
+            if (it != terms.rbegin()) {
+                text += (ai > 0 ? '+' : '-');
             }
-            else {
-                if (ai < 0) {
-                    tout << '-';
-                }
+            else if (ai < 0) {
+                text += '-';
             }
 
-            if (std::max(ai, -ai) != T{1} || i == 0) {
-                tout << std::max(ai, -ai);
+            const T magnitude = std::max(ai, -ai);
+            if (magnitude != T{1} || i == 0) {
+                AppendElement(text, magnitude, out);
             }
 
             if (i != 0) {
-                tout << 't';
+                text += 't';
             }
 
             if (i >= 2) {
-                tout << '^' << i;
+                text += '^';
+                AppendElement(text, i, out);
             }
         }
 
-        return out << tout.str();
+        return out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    T operator[](size_t i) const {
+        if (!sparse_) {
+            return (i < coefficients_.size() ? coefficients_[i] : T{ 0 });
+        }
+
+        auto it = std::lower_bound(terms_.begin(), terms_.end(), i, [](const auto& term, size_t i) { return term.first < i; });
+        return (it != terms_.end() && it->first == i ? it->second : T{ 0 });
+    }
+
+    // -1 for the zero polynomial
+    int Degree() const {
+        if (sparse_) {
+            return (terms_.empty() ? -1 : static_cast<int>(terms_.back().first));
+        }
+        return static_cast<int>(coefficients_.size()) - 1;
+    }
+
+    bool IsZero() const {
+        return coefficients_.empty() && terms_.empty();
+    }
+
+    bool IsSparse() const {
+        return sparse_;
     }
 
-    T operator[](size_t i)
-    {
-        T result = coefficients_[i];
-        if (result == T{ 0 })
-            coefficients_.erase(i);
+    // Coefficients of t^0..t^Degree()
+    std::vector<T> Coefficients() const {
+        if (!sparse_) {
+            return coefficients_;
+        }
+
+        std::vector<T> result(Degree() + 1, T{ 0 });
+        for (const auto& [i, ai] : terms_) {
+            result[i] = ai;
+        }
         return result;
     }
 
+    // Nonzero (degree, coefficient) pairs by increasing degree
+    std::vector<std::pair<size_t, T>> Terms() const {
+        if (sparse_) {
+            return terms_;
+        }
+
+        std::vector<std::pair<size_t, T>> result;
+        ForEachTerm([&](size_t i, const T& ai) {
+            result.emplace_back(i, ai);
+        });
+        return result;
+    }
+
+    // Euclidean division: (q, r) with *this = q * second + r and deg r < deg second. Long division, Newton
+    // division for long operands over exact fields. The leading coefficient of the divisor must be invertible
+    // in T, which always holds for monic divisors such as characteristic polynomials. Named instead of / and %
+    // so that Poly is not taken for a field by IsField, Matrix<Poly<T>> keeps its division-free determinant.
+    std::pair<Poly, Poly> DivMod(const Poly& second) const {
+        if (second.IsZero()) {
+            throw std::domain_error("Polynomial division by zero");
+        }
+        if (Degree() < second.Degree()) {
+            return { Poly(), *this };
+        }
+
+        auto [quotient, remainder] = PolyDivMod(Coefficients(), second.Coefficients());
+        return { Poly(std::move(quotient)), Poly(std::move(remainder)) };
+    }
+
+    Poly Quotient(const Poly& second) const {
+        return DivMod(second).first;
+    }
+
+    Poly Remainder(const Poly& second) const {
+        return DivMod(second).second;
+    }
+
 private:
-    std::unordered_map<int, T> coefficients_;
+    std::vector<T> coefficients_;
+    std::vector<std::pair<size_t, T>> terms_;
+    bool sparse_;
+
+    // Below this degree a polynomial is always dense
+    static constexpr size_t SparseMinDegree = 64;
+    // Dense turns sparse below 1 / SparseFill of nonzero coefficients and sparse turns dense at
+    // 1 / DenseFill. The gap keeps a polynomial near the border from switching back and forth.
+    static constexpr size_t SparseFill = 8;
+    static constexpr size_t DenseFill = 4;
+
+    template<typename F>
+    void ForEachTerm(F f) const {
+        if (sparse_) {
+            for (const auto& [i, ai] : terms_) {
+                f(i, ai);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < coefficients_.size(); ++i) {
+            if (coefficients_[i] != T{ 0 }) {
+                f(i, coefficients_[i]);
+            }
+        }
+    }
+
+    // Drops trailing zeros and picks the form by fill ratio
+    void Normalize() {
+        if (sparse_) {
+            if (terms_.empty() || terms_.back().first < SparseMinDegree || DenseFill * terms_.size() > terms_.back().first) {
+                std::vector<T> dense(terms_.empty() ? 0 : terms_.back().first + 1, T{ 0 });
+                for (auto& [i, ai] : terms_) {
+                    dense[i] = std::move(ai);
+                }
+                coefficients_ = std::move(dense);
+                terms_.clear();
+                sparse_ = false;
+            }
+            return;
+        }
+
+        while (!coefficients_.empty() && coefficients_.back() == T{ 0 }) {
+            coefficients_.pop_back();
+        }
+        if (coefficients_.size() <= SparseMinDegree) {
+            return;
+        }
+
+        const size_t count = coefficients_.size() - std::count(coefficients_.begin(), coefficients_.end(), T{ 0 });
+        if (SparseFill * count < coefficients_.size()) {
+            for (size_t i = 0; i < coefficients_.size(); ++i) {
+                if (coefficients_[i] != T{ 0 }) {
+                    terms_.emplace_back(i, std::move(coefficients_[i]));
+                }
+            }
+            coefficients_.clear();
+            coefficients_.shrink_to_fit();
+            sparse_ = true;
+        }
+    }
+
+    // Sums neighbouring terms of the same degree in sorted terms_ and drops the zeros
+    void MergeTerms() {
+        size_t size = 0;
+        for (size_t k = 0; k < terms_.size(); ++k) {
+            if (size > 0 && terms_[size - 1].first == terms_[k].first) {
+                terms_[size - 1].second += terms_[k].second;
+            }
+            else {
+                terms_[size++] = std::move(terms_[k]);
+            }
+        }
+        terms_.resize(size);
+        terms_.erase(std::remove_if(terms_.begin(), terms_.end(), [](const auto& term) { return term.second == T{ 0 }; }), terms_.end());
+    }
+
+    // op(this[i], second[i]) for every degree, elementwise on vectors when both are dense and by
+    // merging the term lists otherwise
+    template<typename Op>
+    void Combine(const Poly& second, Op op) {
+        if (!sparse_ && !second.sparse_) {
+            if (coefficients_.size() < second.coefficients_.size()) {
+                coefficients_.resize(second.coefficients_.size(), T{ 0 });
+            }
+            for (size_t i = 0; i < second.coefficients_.size(); ++i) {
+                op(coefficients_[i], second.coefficients_[i]);
+            }
+            Normalize();
+            return;
+        }
+
+        const std::vector<std::pair<size_t, T>> first_terms = Terms(), second_terms = second.Terms();
+        std::vector<std::pair<size_t, T>> result;
+        result.reserve(first_terms.size() + second_terms.size());
+        for (size_t k1 = 0, k2 = 0; k1 < first_terms.size() || k2 < second_terms.size();) {
+            if (k2 == second_terms.size() || (k1 < first_terms.size() && first_terms[k1].first < second_terms[k2].first)) {
+                result.push_back(first_terms[k1++]);
+                continue;
+            }
+
+            const size_t i = second_terms[k2].first;
+            T x = (k1 < first_terms.size() && first_terms[k1].first == i ? first_terms[k1++].second : T{ 0 });
+            op(x, second_terms[k2++].second);
+            if (x != T{ 0 }) {
+                result.emplace_back(i, std::move(x));
+            }
+        }
+
+        coefficients_.clear();
+        terms_ = std::move(result);
+        sparse_ = true;
+        Normalize();
+    }
 };
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "poly_multiply.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Division, evaluation and interpolation on coefficient vectors, lowest degree first. The asymptotically
+// fast paths (Newton division, subproduct trees) are used for exact fields only: ModInt and types with
+// a Denominator() such as Rational. Floating point stays with the direct methods, which are stable.
+
+template<typename T, typename = void>
+struct HasExactDivision : std::integral_constant<bool, IsModInt<T>::value> {};
+template<typename T>
+struct HasExactDivision<T, std::void_t<decltype(std::declval<const T&>().Denominator())>> : std::true_type {};
+
+// Quotient and divisor both at least this long go through Newton division
+constexpr size_t PolyFastDivisionThreshold = 128;
+// Below this many points, or below this degree, multipoint evaluation is Horner on every point
+constexpr size_t PolyMultipointThreshold = 128;
+// Points evaluated side by side by Horner, independent chains the compiler can keep in vector registers
+constexpr size_t PolyEvaluationLanes = 8;
+
+template<typename T>
+void PolyTrim(std::vector<T>& a) {
+    while (!a.empty() && a.back() == T{ 0 }) {
+        a.pop_back();
+    }
+}
+
+// First k coefficients of 1 / b, b[0] must be invertible. Newton iteration g = g (2 - b g) doubles the
+// number of correct coefficients with two products per step.
+template<typename T>
+std::vector<T> PolyInverseSeries(const std::vector<T>& b, size_t k) {
+    std::vector<T> g{ T{ 1 } / b[0] };
+    for (size_t length = 1; length < k;) {
+        length = std::min(2 * length, k);
+        std::vector<T> bg = PolyMultiply(std::vector<T>(b.begin(), b.begin() + std::min(b.size(), length)), g);
+        bg.resize(length, T{ 0 });
+        for (T& x : bg) {
+            x = -x;
+        }
+        bg[0] += T{ 2 };
+        g = PolyMultiply(g, bg);
+        g.resize(length, T{ 0 });
+    }
+
+    return g;
+}
+
+// a = q b + r with deg r < deg b, both trimmed, b nonzero. The leading coefficient of b must be
+// invertible in T, which always holds for monic divisors.
+template<typename T>
+std::pair<std::vector<T>, std::vector<T>> PolyDivMod(const std::vector<T>& a, const std::vector<T>& b) {
+    if (a.size() < b.size()) {
+        return { {}, a };
+    }
+
+    const size_t n = a.size() - 1, m = b.size() - 1, k = n - m + 1;
+    if constexpr (HasExactDivision<T>::value) {
+        if (std::min(k, m) >= PolyFastDivisionThreshold) {
+            // rev(q) = rev(a) / rev(b) mod t^k, where rev reverses the coefficients
+            std::vector<T> ra(a.rbegin(), a.rbegin() + k), rb(b.rbegin(), b.rend());
+            std::vector<T> q = PolyMultiply(ra, PolyInverseSeries(rb, k));
+            q.resize(k, T{ 0 });
+            std::reverse(q.begin(), q.end());
+
+            std::vector<T> r = PolyMultiply(b, q);
+            r.resize(m, T{ 0 });
+            for (size_t i = 0; i < m; ++i) {
+                r[i] = a[i] - r[i];
+            }
+            PolyTrim(q);
+            PolyTrim(r);
+            return { std::move(q), std::move(r) };
+        }
+    }
+
+    std::vector<T> remainder = a, quotient(k, T{ 0 });
+    const T& lead = b[m];
+    for (size_t i = k; i-- > 0;) {
+        T f = remainder[i + m];
+        if (f == T{ 0 }) {
+            continue;
+        }
+        if (lead != T{ 1 }) {
+            f = f / lead;
+        }
+
+        quotient[i] = f;
+        for (size_t j = 0; j <= m; ++j) {
+            remainder[i + j] -= f * b[j];
+        }
+    }
+    remainder.resize(m);
+    PolyTrim(quotient);
+    PolyTrim(remainder);
+
+    return { std::move(quotient), std::move(remainder) };
+}
+
+// Horner on blocks of PolyEvaluationLanes points, blocks in parallel
+template<typename T>
+std::vector<T> PolyEvaluateHorner(const std::vector<T>& a, const std::vector<T>& points) {
+    std::vector<T> values(points.size(), T{ 0 });
+    if (a.empty()) {
+        return values;
+    }
+
+    const size_t blocks = (points.size() + PolyEvaluationLanes - 1) / PolyEvaluationLanes;
+    const size_t grain = std::max<size_t>(1, (1 << 14) / (a.size() * PolyEvaluationLanes));
+    ParallelFor(0, blocks, grain, [&](size_t lo, size_t hi) {
+        T x[PolyEvaluationLanes], acc[PolyEvaluationLanes];
+        for (size_t block = lo; block < hi; ++block) {
+            const size_t first = block * PolyEvaluationLanes, count = std::min(PolyEvaluationLanes, points.size() - first);
+            for (size_t l = 0; l < PolyEvaluationLanes; ++l) {
+                x[l] = (l < count ? points[first + l] : T{ 0 });
+                acc[l] = a.back();
+            }
+            for (size_t i = a.size() - 1; i-- > 0;) {
+                for (size_t l = 0; l < PolyEvaluationLanes; ++l) {
+                    acc[l] = acc[l] * x[l] + a[i];
+                }
+            }
+            std::copy(acc, acc + count, values.begin() + first);
+        }
+    });
+
+    return values;
+}
+
+// Products of (t - x_i) over halves, quarters, ... of the points. Evaluation reduces a polynomial modulo
+// the nodes from the root down, interpolation combines Lagrange weights from the leaves up, both in
+// O(d log^2 d) with fast multiplication. The two halves of large nodes are processed in parallel.
+template<typename T>
+class SubproductTree {
+public:
+    explicit SubproductTree(std::vector<T> points) : points(std::move(points)), nodes(4 * std::max<size_t>(this->points.size(), 1)) {
+        if (!this->points.empty()) {
+            Build(1, 0, this->points.size());
+        }
+    }
+
+    const std::vector<T>& Points() const {
+        return points;
+    }
+
+    // Product of (t - x_i) over all points
+    const std::vector<T>& Root() const {
+        return nodes[1];
+    }
+
+    std::vector<T> Evaluate(const std::vector<T>& a) const {
+        std::vector<T> values(points.size(), T{ 0 });
+        if (!points.empty()) {
+            Evaluate(1, 0, points.size(), PolyDivMod(a, nodes[1]).second, values);
+        }
+        return values;
+    }
+
+    // The polynomial of degree below Points().size() that takes values[i] at points[i]
+    std::vector<T> Interpolate(const std::vector<T>& values) const {
+        if (values.size() != points.size()) {
+            throw std::invalid_argument("Interpolate must take one value per point");
+        }
+        if (points.empty()) {
+            return {};
+        }
+
+        // values[i] / M'(x_i), M'(x_i) is the product of x_i - x_j over the other points
+        std::vector<T> derivative(nodes[1].size() - 1);
+        for (size_t i = 1; i < nodes[1].size(); ++i) {
+            derivative[i - 1] = nodes[1][i] * T(static_cast<long long>(i));
+        }
+        std::vector<T> weights = Evaluate(derivative);
+        for (size_t i = 0; i < weights.size(); ++i) {
+            if (weights[i] == T{ 0 }) {
+                throw std::domain_error("Interpolation points must be distinct");
+            }
+            weights[i] = values[i] / weights[i];
+        }
+
+        std::vector<T> result = Combine(1, 0, points.size(), weights);
+        PolyTrim(result);
+        return result;
+    }
+
+private:
+    std::vector<T> points;
+    std::vector<std::vector<T>> nodes;
+
+    // Ranges at least this long hand their halves to the thread pool
+    static constexpr size_t ParallelSize = 1 << 12;
+    // Ranges this short are finished directly: Horner on the remainder, Lagrange sums for interpolation
+    static constexpr size_t LeafSize = 32;
+
+    template<typename F>
+    static void ForHalves(size_t size, F f) {
+        if (size >= ParallelSize) {
+            ParallelFor(0, 2, 1, [&](size_t lo, size_t hi) {
+                for (size_t half = lo; half < hi; ++half) {
+                    f(half);
+                }
+            });
+        }
+        else {
+            f(0);
+            f(1);
+        }
+    }
+
+    void Build(size_t v, size_t l, size_t r) {
+        if (r - l == 1) {
+            nodes[v] = { -points[l], T{ 1 } };
+            return;
+        }
+
+        const size_t middle = (l + r) / 2;
+        ForHalves(r - l, [&](size_t half) {
+            if (half == 0) {
+                Build(2 * v, l, middle);
+            }
+            else {
+                Build(2 * v + 1, middle, r);
+            }
+        });
+        nodes[v] = PolyMultiply(nodes[2 * v], nodes[2 * v + 1]);
+    }
+
+    void Evaluate(size_t v, size_t l, size_t r, const std::vector<T>& a, std::vector<T>& values) const {
+        if (r - l <= LeafSize) {
+            const std::vector<T> part = PolyEvaluateHorner(a, std::vector<T>(points.begin() + l, points.begin() + r));
+            std::copy(part.begin(), part.end(), values.begin() + l);
+            return;
+        }
+
+        const size_t middle = (l + r) / 2;
+        ForHalves(r - l, [&](size_t half) {
+            if (half == 0) {
+                Evaluate(2 * v, l, middle, PolyDivMod(a, nodes[2 * v]).second, values);
+            }
+            else {
+                Evaluate(2 * v + 1, middle, r, PolyDivMod(a, nodes[2 * v + 1]).second, values);
+            }
+        });
+    }
+
+    // Sum of weights[i] * M(t) / (t - x_i) over the points of the node, M being the node polynomial
+    std::vector<T> Combine(size_t v, size_t l, size_t r, const std::vector<T>& weights) const {
+        if (r - l <= LeafSize) {
+            // Synthetic division of M by every t - x_i, the quotients are summed as they come out
+            const std::vector<T>& product = nodes[v];
+            std::vector<T> result(r - l, T{ 0 });
+            for (size_t i = l; i < r; ++i) {
+                T carry{ 0 };
+                for (size_t j = r - l; j-- > 0;) {
+                    carry = product[j + 1] + carry * points[i];
+                    result[j] += weights[i] * carry;
+                }
+            }
+            return result;
+        }
+
+        const size_t middle = (l + r) / 2;
+        std::vector<T> left, right;
+        ForHalves(r - l, [&](size_t half) {
+            if (half == 0) {
+                left = PolyMultiply(Combine(2 * v, l, middle, weights), nodes[2 * v + 1]);
+            }
+            else {
+                right = PolyMultiply(Combine(2 * v + 1, middle, r, weights), nodes[2 * v]);
+            }
+        });
+
+        if (left.size() < right.size()) {
+            std::swap(left, right);
+        }
+        for (size_t i = 0; i < right.size(); ++i) {
+            left[i] += right[i];
+        }
+        return left;
+    }
+};
@@ -0,0 +1,493 @@
+#pragma once
+
+#include "mod_int.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Products of coefficient vectors for Poly. Operands shorter than PolyKaratsubaThreshold are multiplied
+// by the schoolbook rule, longer ones by Karatsuba. When both reach PolyTransformThreshold, floating
+// point and complex coefficients go through an FFT. ModInt<P> for a prime P with enough factors 2 in P - 1
+// is transformed in its own field. Integers and the other moduli go through number theoretic transforms
+// modulo several primes joined by the Chinese remainder theorem. Other types, and integers too large for
+// four primes, stay with Karatsuba.
+constexpr size_t PolyKaratsubaThreshold = 32;
+constexpr size_t PolyTransformThreshold = 128;
+
+template<typename T>
+struct IsModInt : std::false_type {};
+template<uint64_t P>
+struct IsModInt<ModInt<P>> : std::true_type {};
+
+template<typename T>
+struct IsComplex : std::false_type {};
+template<typename R>
+struct IsComplex<std::complex<R>> : std::true_type {};
+
+// c[i + j] += a[i] * b[j]
+template<typename T>
+void PolyMultiplySchoolbook(const T* a, size_t n, const T* b, size_t m, T* c) {
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] == T{ 0 }) {
+            continue;
+        }
+        for (size_t j = 0; j < m; ++j) {
+            c[i + j] += a[i] * b[j];
+        }
+    }
+}
+
+// c[0..2n-1) += a[0..n) * b[0..n)
+template<typename T>
+void PolyKaratsuba(const T* a, const T* b, size_t n, T* c) {
+    if (n < PolyKaratsubaThreshold) {
+        PolyMultiplySchoolbook(a, n, b, n, c);
+        return;
+    }
+
+    // a = a0 + t^h a1, a0 * b0 and a1 * b1 are reused for the middle part
+    const size_t h = n / 2, k = n - h;
+    std::vector<T> sa(k), sb(k), low(2 * h - 1, T{ 0 }), high(2 * k - 1, T{ 0 }), middle(2 * k - 1, T{ 0 });
+    for (size_t i = 0; i < k; ++i) {
+        sa[i] = (i < h ? a[i] + a[h + i] : a[h + i]);
+        sb[i] = (i < h ? b[i] + b[h + i] : b[h + i]);
+    }
+    PolyKaratsuba(a, b, h, low.data());
+    PolyKaratsuba(a + h, b + h, k, high.data());
+    PolyKaratsuba(sa.data(), sb.data(), k, middle.data());
+
+    for (size_t i = 0; i < low.size(); ++i) {
+        c[i] += low[i];
+        middle[i] -= low[i];
+    }
+    for (size_t i = 0; i < high.size(); ++i) {
+        c[2 * h + i] += high[i];
+        middle[i] -= high[i];
+    }
+    for (size_t i = 0; i < middle.size(); ++i) {
+        c[h + i] += middle[i];
+    }
+}
+
+// The longer operand is cut into pieces of the length of the shorter one
+template<typename T>
+std::vector<T> PolyMultiplyKaratsuba(const std::vector<T>& first, const std::vector<T>& second) {
+    const std::vector<T>& a = (first.size() >= second.size() ? first : second);
+    const std::vector<T>& b = (first.size() >= second.size() ? second : first);
+    const size_t n = a.size(), m = b.size();
+
+    std::vector<T> result(n + m - 1, T{ 0 }), piece(m), product(2 * m - 1);
+    for (size_t start = 0; start < n; start += m) {
+        const size_t length = std::min(m, n - start);
+        if (length == m) {
+            PolyKaratsuba(a.data() + start, b.data(), m, result.data() + start);
+            continue;
+        }
+
+        std::copy(a.begin() + start, a.end(), piece.begin());
+        std::fill(piece.begin() + length, piece.end(), T{ 0 });
+        std::fill(product.begin(), product.end(), T{ 0 });
+        PolyKaratsuba(piece.data(), b.data(), m, product.data());
+        for (size_t i = 0; start + i < result.size(); ++i) {
+            result[start + i] += product[i];
+        }
+    }
+
+    return result;
+}
+
+// Largest k with 2^k dividing P - 1 and a root of unity of order exactly 2^k modulo the prime P. The root is
+// c^((P - 1) / 2^k) for the first c that is a quadratic non-residue, which is then -1 at order 2^(k - 1).
+// { 0, 1 } when there is none, e.g. for a runtime modulus.
+template<uint64_t P>
+const std::pair<size_t, ModInt<P>>& NttRootOfUnity() {
+    static const std::pair<size_t, ModInt<P>> root = [] {
+        if constexpr (P < 3) {
+            return std::pair<size_t, ModInt<P>>(0, ModInt<P>());
+        }
+        else {
+            size_t k = 0;
+            while (((P - 1) >> k) % 2 == 0) {
+                ++k;
+            }
+            for (uint64_t c = 2; c < 256; ++c) {
+                const ModInt<P> w = ModInt<P>(c).Pow(static_cast<long long>((P - 1) >> k));
+                ModInt<P> x = w;
+                for (size_t i = 1; i < k; ++i) {
+                    x *= x;
+                }
+                if (x == -ModInt<P>(1)) {
+                    return std::pair<size_t, ModInt<P>>(k, w);
+                }
+            }
+            return std::pair<size_t, ModInt<P>>(0, ModInt<P>());
+        }
+    }();
+    return root;
+}
+
+// In place, a.size() must be a power of two up to 2^k of NttRootOfUnity<P>
+template<uint64_t P>
+void Ntt(std::vector<ModInt<P>>& a, bool inverse) {
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    const auto& [order, root] = NttRootOfUnity<P>();
+    std::vector<ModInt<P>> roots;
+    for (size_t length = 2, level = 1; length <= n; length <<= 1, ++level) {
+        const ModInt<P> w = root.Pow(static_cast<long long>(1ULL << (order - level)) * (inverse ? -1 : 1));
+        roots.assign(length / 2, ModInt<P>(1));
+        for (size_t j = 1; j < length / 2; ++j) {
+            roots[j] = roots[j - 1] * w;
+        }
+
+        for (size_t i = 0; i < n; i += length) {
+            for (size_t j = 0; j < length / 2; ++j) {
+                const ModInt<P> u = a[i + j], v = a[i + j + length / 2] * roots[j];
+                a[i + j] = u + v;
+                a[i + j + length / 2] = u - v;
+            }
+        }
+    }
+
+    if (inverse) {
+        const ModInt<P> scale = ModInt<P>(static_cast<unsigned long long>(n)).Inverse();
+        for (auto& x : a) {
+            x *= scale;
+        }
+    }
+}
+
+// Cyclic product of residues modulo P, of the given power of two length
+template<uint64_t P>
+std::vector<uint64_t> NttConvolution(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b, size_t length) {
+    std::vector<ModInt<P>> fa(length), fb(length);
+    for (size_t i = 0; i < a.size(); ++i) {
+        fa[i] = ModInt<P>(a[i] % P);
+    }
+    for (size_t i = 0; i < b.size(); ++i) {
+        fb[i] = ModInt<P>(b[i] % P);
+    }
+
+    Ntt(fa, false);
+    Ntt(fb, false);
+    for (size_t i = 0; i < length; ++i) {
+        fa[i] *= fb[i];
+    }
+    Ntt(fa, true);
+
+    std::vector<uint64_t> result(a.size() + b.size() - 1);
+    for (size_t i = 0; i < result.size(); ++i) {
+        result[i] = fa[i].Value();
+    }
+    return result;
+}
+
+// Primes 2^23 * c + 1 below 2^30, by decreasing size. Six of them cover the products of residues of any
+// ModInt modulus below 2^63, integer products are rebuilt in 128 bits and use the first four at most.
+constexpr size_t NttPrimeCount = 6;
+constexpr uint64_t NttPrimes[NttPrimeCount] = { 998244353, 897581057, 880803841, 754974721, 645922817, 595591169 };
+constexpr size_t NttIntegerPrimeCount = 4;
+
+template<size_t... I>
+std::vector<uint64_t> NttConvolutionModPrime(size_t t, const std::vector<uint64_t>& a, const std::vector<uint64_t>& b, size_t length, std::index_sequence<I...>) {
+    using Convolution = std::vector<uint64_t>(*)(const std::vector<uint64_t>&, const std::vector<uint64_t>&, size_t);
+    static constexpr Convolution convolutions[] = { &NttConvolution<NttPrimes[I]>... };
+    return convolutions[t](a, b, length);
+}
+
+// One transform in the field itself, for a prime P with a root of unity of the needed power of two order.
+// false otherwise, e.g. for a runtime modulus or a P - 1 with too few factors 2.
+template<uint64_t P>
+bool PolyMultiplyNttDirect(const std::vector<ModInt<P>>& a, const std::vector<ModInt<P>>& b, std::vector<ModInt<P>>& result) {
+    if constexpr (P == 0) {
+        return false;
+    }
+
+    size_t length = 1;
+    while (length < a.size() + b.size() - 1) {
+        length <<= 1;
+    }
+    const size_t order = NttRootOfUnity<P>().first;
+    if (order >= 63 || length > (size_t{ 1 } << order)) {
+        return false;
+    }
+
+    std::vector<ModInt<P>> fa(length), fb(length);
+    std::copy(a.begin(), a.end(), fa.begin());
+    std::copy(b.begin(), b.end(), fb.begin());
+    ParallelFor(0, 2, 1, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; ++t) {
+            Ntt(t == 0 ? fa : fb, false);
+        }
+    });
+    for (size_t i = 0; i < length; ++i) {
+        fa[i] *= fb[i];
+    }
+    Ntt(fa, true);
+
+    fa.resize(a.size() + b.size() - 1);
+    result = std::move(fa);
+    return true;
+}
+
+// Exact integer product of the two sequences, or false when it can exceed what the primes recover. Entries of
+// integral types may be negative. ModInt entries are taken as their residues in [0, P) and the product is
+// reduced modulo P while it is rebuilt, so any modulus below 2^63 is covered.
+template<typename T>
+bool PolyMultiplyNtt(const std::vector<T>& a, const std::vector<T>& b, std::vector<T>& result) {
+    const auto magnitude = [](const T& x) -> uint64_t {
+        if constexpr (IsModInt<T>::value) {
+            return x.Value();
+        }
+        else if constexpr (std::is_signed<T>::value) {
+            return (x < 0 ? 0 - static_cast<uint64_t>(x) : static_cast<uint64_t>(x));
+        }
+        else {
+            return static_cast<uint64_t>(x);
+        }
+    };
+
+    uint64_t maxA = 1, maxB = 1;
+    for (const T& x : a) {
+        maxA = std::max(maxA, magnitude(x));
+    }
+    for (const T& x : b) {
+        maxB = std::max(maxB, magnitude(x));
+    }
+
+    // Products are recovered in [-M/2, M/2), one bit for the sign and one of slack
+    const double bits = std::log2(static_cast<double>(maxA)) + std::log2(static_cast<double>(maxB)) + std::log2(static_cast<double>(std::min(a.size(), b.size()))) + 2;
+    const size_t maxPrimes = (IsModInt<T>::value ? NttPrimeCount : NttIntegerPrimeCount);
+    size_t primes = 0;
+    for (double covered = 0; covered < bits; ++primes) {
+        if (primes == maxPrimes) {
+            return false;
+        }
+        covered += std::log2(static_cast<double>(NttPrimes[primes]));
+    }
+
+    size_t length = 1;
+    while (length < a.size() + b.size() - 1) {
+        length <<= 1;
+    }
+    if (length > (size_t{ 1 } << 23)) {
+        return false;
+    }
+
+    // Residues modulo p, negative entries taken as p - (|x| mod p)
+    const auto residues = [&](const std::vector<T>& v, uint64_t p) {
+        std::vector<uint64_t> r(v.size());
+        for (size_t i = 0; i < v.size(); ++i) {
+            if constexpr (IsModInt<T>::value) {
+                r[i] = v[i].Value() % p;
+            }
+            else if constexpr (std::is_signed<T>::value) {
+                const uint64_t x = magnitude(v[i]) % p;
+                r[i] = (v[i] < 0 && x != 0 ? p - x : x);
+            }
+            else {
+                r[i] = static_cast<uint64_t>(v[i]) % p;
+            }
+        }
+        return r;
+    };
+
+    std::vector<std::vector<uint64_t>> products(primes);
+    ParallelFor(0, primes, 1, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; ++t) {
+            products[t] = NttConvolutionModPrime(t, residues(a, NttPrimes[t]), residues(b, NttPrimes[t]), length, std::make_index_sequence<NttPrimeCount>());
+        }
+    });
+
+    // Garner: x = v0 + p0 (v1 + p1 (v2 + ...)) with digits vt in [0, pt)
+    uint64_t inverses[NttPrimeCount][NttPrimeCount] = {};
+    for (size_t s = 0; s < primes; ++s) {
+        for (size_t t = s + 1; t < primes; ++t) {
+            // p_s^-1 mod p_t by Fermat
+            uint64_t result = 1, base = NttPrimes[s] % NttPrimes[t], e = NttPrimes[t] - 2;
+            for (; e; e >>= 1, base = base * base % NttPrimes[t]) {
+                if (e & 1) {
+                    result = result * base % NttPrimes[t];
+                }
+            }
+            inverses[s][t] = result;
+        }
+    }
+
+    unsigned __int128 modulus = 1;
+    for (size_t t = 0; t < std::min(primes, NttIntegerPrimeCount); ++t) {
+        modulus *= NttPrimes[t];
+    }
+
+    result.assign(a.size() + b.size() - 1, T{});
+    for (size_t i = 0; i < result.size(); ++i) {
+        uint64_t digits[NttPrimeCount];
+        for (size_t t = 0; t < primes; ++t) {
+            const uint64_t p = NttPrimes[t];
+            uint64_t v = products[t][i];
+            for (size_t s = 0; s < t; ++s) {
+                v = (v + p - digits[s] % p) % p * inverses[s][t] % p;
+            }
+            digits[t] = v;
+        }
+
+        if constexpr (IsModInt<T>::value) {
+            T x{ 0 };
+            for (size_t t = primes; t-- > 0;) {
+                x = x * T(NttPrimes[t]) + T(digits[t]);
+            }
+            result[i] = x;
+        }
+        else {
+            unsigned __int128 x = 0;
+            for (size_t t = primes; t-- > 0;) {
+                x = x * NttPrimes[t] + digits[t];
+            }
+
+            if (x > modulus / 2) {
+                result[i] = static_cast<T>(-static_cast<__int128>(modulus - x));
+            }
+            else {
+                result[i] = static_cast<T>(x);
+            }
+        }
+    }
+
+    return true;
+}
+
+// In place, a.size() a power of two
+template<typename R>
+void Fft(std::vector<std::complex<R>>& a, bool inverse) {
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    // Every root is computed directly, repeated multiplication would accumulate rounding errors
+    const R pi = std::acos(R(-1));
+    std::vector<std::complex<R>> roots(n / 2);
+    for (size_t j = 0; j < n / 2; ++j) {
+        roots[j] = std::polar(R(1), (inverse ? -2 : 2) * pi * static_cast<R>(j) / static_cast<R>(n));
+    }
+
+    for (size_t length = 2; length <= n; length <<= 1) {
+        const size_t step = n / length;
+        for (size_t i = 0; i < n; i += length) {
+            for (size_t j = 0; j < length / 2; ++j) {
+                const std::complex<R> u = a[i + j], v = a[i + j + length / 2] * roots[j * step];
+                a[i + j] = u + v;
+                a[i + j + length / 2] = u - v;
+            }
+        }
+    }
+
+    if (inverse) {
+        for (auto& x : a) {
+            x /= static_cast<R>(n);
+        }
+    }
+}
+
+// Real operands share one transform as real and imaginary part: with C = FFT(a + ib),
+// FFT(a)[k] FFT(b)[k] = (C[k]^2 - conj(C[-k])^2) / 4i
+template<typename T>
+std::vector<T> PolyMultiplyFft(const std::vector<T>& a, const std::vector<T>& b) {
+    size_t length = 1;
+    while (length < a.size() + b.size() - 1) {
+        length <<= 1;
+    }
+
+    std::vector<T> result(a.size() + b.size() - 1);
+    if constexpr (IsComplex<T>::value) {
+        std::vector<T> fa(length), fb(length);
+        std::copy(a.begin(), a.end(), fa.begin());
+        std::copy(b.begin(), b.end(), fb.begin());
+        Fft(fa, false);
+        Fft(fb, false);
+        for (size_t i = 0; i < length; ++i) {
+            fa[i] *= fb[i];
+        }
+        Fft(fa, true);
+        std::copy(fa.begin(), fa.begin() + result.size(), result.begin());
+    }
+    else {
+        using Complex = std::complex<T>;
+        std::vector<Complex> c(length);
+        for (size_t i = 0; i < a.size(); ++i) {
+            c[i].real(a[i]);
+        }
+        for (size_t i = 0; i < b.size(); ++i) {
+            c[i].imag(b[i]);
+        }
+        Fft(c, false);
+
+        std::vector<Complex> product(length);
+        for (size_t i = 0; i < length; ++i) {
+            const Complex x = c[i], y = std::conj(c[(length - i) & (length - 1)]);
+            product[i] = (x * x - y * y) / Complex(0, 4);
+        }
+        Fft(product, true);
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = product[i].real();
+        }
+    }
+
+    return result;
+}
+
+template<typename T>
+std::vector<T> PolyMultiply(const std::vector<T>& a, const std::vector<T>& b) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+
+    const size_t shorter = std::min(a.size(), b.size());
+    if (shorter < PolyKaratsubaThreshold) {
+        std::vector<T> result(a.size() + b.size() - 1, T{ 0 });
+        PolyMultiplySchoolbook(a.data(), a.size(), b.data(), b.size(), result.data());
+        return result;
+    }
+
+    if (shorter >= PolyTransformThreshold) {
+        if constexpr (std::is_floating_point<T>::value || IsComplex<T>::value) {
+            return PolyMultiplyFft(a, b);
+        }
+        else if constexpr ((std::is_integral<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= sizeof(uint64_t)) || IsModInt<T>::value) {
+            std::vector<T> result;
+            if constexpr (IsModInt<T>::value) {
+                if (PolyMultiplyNttDirect(a, b, result)) {
+                    return result;
+                }
+            }
+            if (PolyMultiplyNtt(a, b, result)) {
+                return result;
+            }
+        }
+    }
+
+    return PolyMultiplyKaratsuba(a, b);
+}
@@ -1,53 +1,112 @@
 #include "rational.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
 #include <string>
 using namespace std;
 
 Rational::Rational() : a(0), b(1) {}
 
+Rational::Rational(const BigInteger& x) : Rational(x, BigInteger(1)) {}
+
+Rational::Rational(const BigInteger& a, const BigInteger& b) : a(0), b(1) {
+	if (b.IsZero())
+		throw std::out_of_range("Divide by zero exception");
+
+	const BigInteger gcd = Gcd(a, b);
+	BigInteger numerator = a / gcd, denominator = b / gcd;
+	if (denominator.Sign() < 0) {
+		numerator = -numerator;
+		denominator = -denominator;
+	}
+
+	// The minimal long long is kept out of the inline form, so that negating it never overflows
+	if (numerator.FitsLongLong() && denominator.FitsLongLong() && numerator.ToLongLong() != LLONG_MIN && denominator.ToLongLong() != LLONG_MIN) {
+		this->a = numerator.ToLongLong();
+		this->b = denominator.ToLongLong();
+	}
+	else {
+		big = make_shared<const BigFraction>(BigFraction{ numerator, denominator });
+	}
+}
+
+BigInteger Rational::Numerator() const {
+	return (big ? big->a : BigInteger(Reduced().a));
+}
+
+BigInteger Rational::Denominator() const {
+	return (big ? big->b : BigInteger(Reduced().b));
+}
+
 Rational& Rational::operator++() {
-	a += b;
-	return *this;
+	return *this += 1;
 }
 
 Rational Rational::operator++(int) {
 	Rational result = *this;
-	a += b;
+	*this += 1;
 	return result;
 }
 
 Rational& Rational::operator--() {
-	a -= b;
-	return *this;
+	return *this -= 1;
 }
 
 Rational Rational::operator--(int) {
 	Rational result = *this;
-	a -= b;
+	*this -= 1;
 	return result;
 }
 
 Rational Rational::operator+() const {
-	return Rational(+a, b);
+	return *this;
 }
 
 Rational Rational::operator-() const {
-	return Rational(-a, b);
+	if (big)
+		return Rational(-big->a, big->b);
+
+	Rational result = *this;
+	result.a = -a;
+	return result;
 }
 
 Rational operator+(const Rational& first, const Rational& second) {
-	return Rational(first.a * second.b + second.a * first.b, first.b * second.b);
+	long long x, y, numerator, denominator;
+	if (!first.big && !second.big
+		&& !__builtin_mul_overflow(first.a, second.b, &x) && !__builtin_mul_overflow(second.a, first.b, &y)
+		&& !__builtin_add_overflow(x, y, &numerator) && !__builtin_mul_overflow(first.b, second.b, &denominator))
+		return Rational(numerator, denominator);
+
+	return Rational(first.Numerator() * second.Denominator() + second.Numerator() * first.Denominator(), first.Denominator() * second.Denominator());
 }
 
 Rational operator-(const Rational& first, const Rational& second) {
-	return Rational(first.a * second.b - second.a * first.b, first.b * second.b);
+	long long x, y, numerator, denominator;
+	if (!first.big && !second.big
+		&& !__builtin_mul_overflow(first.a, second.b, &x) && !__builtin_mul_overflow(second.a, first.b, &y)
+		&& !__builtin_sub_overflow(x, y, &numerator) && !__builtin_mul_overflow(first.b, second.b, &denominator))
+		return Rational(numerator, denominator);
+
+	return Rational(first.Numerator() * second.Denominator() - second.Numerator() * first.Denominator(), first.Denominator() * second.Denominator());
 }
 
 Rational operator*(const Rational& first, const Rational& second) {
-	return Rational(first.a * second.a, first.b * second.b);
+	long long numerator, denominator;
+	if (!first.big && !second.big
+		&& !__builtin_mul_overflow(first.a, second.a, &numerator) && !__builtin_mul_overflow(first.b, second.b, &denominator))
+		return Rational(numerator, denominator);
+
+	return Rational(first.Numerator() * second.Numerator(), first.Denominator() * second.Denominator());
 }
 
 Rational operator/(const Rational& first, const Rational& second) {
-	return Rational(first.a * second.b, first.b * second.a);
+	long long numerator, denominator;
+	if (!first.big && !second.big
+		&& !__builtin_mul_overflow(first.a, second.b, &numerator) && !__builtin_mul_overflow(first.b, second.a, &denominator))
+		return Rational(numerator, denominator);
+
+	return Rational(first.Numerator() * second.Denominator(), first.Denominator() * second.Numerator());
 }
 
 Rational& Rational::operator+=(const Rational& second) {
@@ -67,51 +126,170 @@ Rational& Rational::operator/=(const Rational& second) {
 }
 
 bool operator==(const Rational& first, const Rational& second) {
-	return first.a == second.a && first.b == second.b;
+	if (first.big || second.big)
+		return first.big && second.big && first.big->a == second.big->a && first.big->b == second.big->b;
+
+	return (first.a == second.a && first.b == second.b) || Rational::Compare(first, second) == 0;
 }
 
 bool operator!=(const Rational& first, const Rational& second) {
-	return first.a != second.a || first.b != second.b;
+	return !(first == second);
 }
 
 bool operator<(const Rational& first, const Rational& second) {
-	return (first - second).a < 0;
+	return Rational::Compare(first, second) < 0;
 }
 
 bool operator<=(const Rational& first, const Rational& second) {
-	return (first - second).a <= 0;
+	return Rational::Compare(first, second) <= 0;
 }
 
 bool operator>(const Rational& first, const Rational& second) {
-	return (first - second).a > 0;
+	return Rational::Compare(first, second) > 0;
 }
 
 bool operator>=(const Rational& first, const Rational& second) {
-	return (first - second).a >= 0;
+	return Rational::Compare(first, second) >= 0;
 }
 
 std::ostream& operator<<(std::ostream& out, const Rational& r) {
-	if (r.b == 1)
-		return out << r.a;
-	return out << to_string(r.a) + '/' + to_string(r.b);
+	string text;
+	AppendText(text, r);
+	return out << text;
 }
 
-void Rational::Reduce() {
-	const auto count_gcd = [](long long a, long long b) -> long long {
-		a = abs(a); b = abs(b);
-		while (a > 0) {
-			b %= a;
-			swap(a, b);
+void AppendText(string& out, const Rational& r) {
+	if (r.big) {
+		out += r.big->a.ToString();
+		if (!(r.big->b == 1))
+			out += '/' + r.big->b.ToString();
+		return;
+	}
+
+	const Rational reduced = r.Reduced();
+	char digits[24];
+	out.append(digits, to_chars(digits, digits + sizeof(digits), reduced.a).ptr);
+	if (reduced.b != 1) {
+		out += '/';
+		out.append(digits, to_chars(digits, digits + sizeof(digits), reduced.b).ptr);
+	}
+}
+
+// Decimal digits with an optional sign, 18 digits per BigInteger step
+static bool ParseInteger(const char* first, const char* last, BigInteger& x) {
+	const bool negative = (first != last && *first == '-');
+	if (first != last && (*first == '-' || *first == '+'))
+		++first;
+	if (first == last)
+		return false;
+
+	x = BigInteger(0);
+	while (first != last) {
+		const char* end = first + min<ptrdiff_t>(18, last - first);
+		long long chunk = 0, scale = 1;
+		for (const char* c = first; c != end; ++c) {
+			if (*c < '0' || *c > '9')
+				return false;
+			chunk = chunk * 10 + (*c - '0');
+			scale *= 10;
 		}
-		return b;
-	};
+		x = x * BigInteger(scale) + BigInteger(chunk);
+		first = end;
+	}
+	if (negative)
+		x = -x;
+	return true;
+}
 
-	long long gcd = count_gcd(a, b);
-	a /= gcd; b /= gcd;
+bool ParseText(string_view token, Rational& r) {
+	const char* first = token.data() + (!token.empty() && token.front() == '+');
+	const char* last = token.data() + token.size();
+	const char* slash = find(first, last, '/');
+
+	long long a = 0, b = 1;
+	auto [aEnd, aError] = from_chars(first, slash, a);
+	bool fits = (aError == errc() && aEnd == slash);
+	if (fits && slash != last) {
+		auto [bEnd, bError] = from_chars(slash + 1, last, b);
+		fits = (bError == errc() && bEnd == last);
+	}
+	if (fits) {
+		if (b == 0)
+			return false;
+		r = Rational(a, b);
+		return true;
+	}
+
+	BigInteger numerator, denominator(1);
+	if (!ParseInteger(first, slash, numerator) || (slash != last && !ParseInteger(slash + 1, last, denominator)) || denominator.IsZero())
+		return false;
+	r = Rational(numerator, denominator);
+	return true;
+}
+
+// Stein's algorithm: shifts and subtractions only
+static unsigned long long BinaryGcd(unsigned long long x, unsigned long long y) {
+	if (x == 0 || y == 0)
+		return x | y;
+
+	const int shift = __builtin_ctzll(x | y);
+	x >>= __builtin_ctzll(x);
+	while (y != 0) {
+		y >>= __builtin_ctzll(y);
+		if (x > y)
+			swap(x, y);
+		y -= x;
+	}
+
+	return x << shift;
+}
+
+void Rational::Reduce() {
+	if (a == LLONG_MIN || b == LLONG_MIN) {
+		*this = Rational(BigInteger(a), BigInteger(b));
+		return;
+	}
 
 	if (b < 0) {
 		a = -a; b = -b;
 	}
+
+	const unsigned long long magnitude = static_cast<unsigned long long>(a < 0 ? -a : a);
+	if (ALGEBRA_RATIONAL_LAZY_BITS > 0 && (magnitude | static_cast<unsigned long long>(b)) >> ALGEBRA_RATIONAL_LAZY_BITS == 0)
+		return;
+
+	const long long gcd = static_cast<long long>(BinaryGcd(magnitude, static_cast<unsigned long long>(b)));
+	a /= gcd; b /= gcd;
+}
+
+Rational Rational::Reduced() const {
+	if (!big && (a == LLONG_MIN || b == LLONG_MIN))
+		return Rational(BigInteger(a), BigInteger(b));
+
+	Rational result = *this;
+	if (!big) {
+		const long long gcd = static_cast<long long>(BinaryGcd(static_cast<unsigned long long>(a < 0 ? -a : a), static_cast<unsigned long long>(b)));
+		result.a /= gcd; result.b /= gcd;
+	}
+
+	return result;
+}
+
+int Rational::Sign() const {
+	if (big)
+		return big->a.Sign();
+
+	return (a > 0) - (a < 0);
+}
+
+int Rational::Compare(const Rational& first, const Rational& second) {
+	if (first.big || second.big) {
+		const BigInteger x = first.Numerator() * second.Denominator(), y = second.Numerator() * first.Denominator();
+		return (x < y ? -1 : (y < x ? 1 : 0));
+	}
+
+	const __int128 x = static_cast<__int128>(first.a) * second.b, y = static_cast<__int128>(second.a) * first.b;
+	return (x < y ? -1 : (y < x ? 1 : 0));
 }
 
 namespace std {
@@ -1,26 +1,63 @@
 #pragma once
 
-#include <iostream>
+#include "big_integer.h"
 
+#include <climits>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Inline values whose numerator and denominator both stay below 2^ALGEBRA_RATIONAL_LAZY_BITS are not reduced
+// right away: a product of two of them cannot overflow, and the gcd is paid once it grows past the bound or
+// when the value is printed. 0 reduces every result eagerly.
+#ifndef ALGEBRA_RATIONAL_LAZY_BITS
+#define ALGEBRA_RATIONAL_LAZY_BITS 31
+#endif
+
+// Numerator and denominator live inline as long long while they fit. Every operation checks for overflow
+// with the compiler builtins and only then promotes to BigInteger, so the common case never allocates.
+// A value that fits inline is always stored inline, and the denominator is always positive, so
+// comparisons are a cross-multiplication in 128 bits even for values that are not reduced yet.
 class Rational {
 public:
     Rational();
+    Rational(const BigInteger& x);
+    Rational(const BigInteger& a, const BigInteger& b);
 
     template<typename T>
-    Rational(T x) : a(static_cast<long long>(x)), b(1) {
+    Rational(T x) : a(0), b(1) {
         static_assert(std::is_integral<T>::value, "Integral type required");
+        if (FitsInline(x))
+            a = static_cast<long long>(x);
+        else
+            *this = Rational(ToBigInteger(x));
     }
 
     template<typename T>
-    Rational(typename std::enable_if<std::is_arithmetic<T>::value, T>::type a, T b) : a(static_cast<long long>(a)), b(static_cast<long long>(b)) {
+    Rational(typename std::enable_if<std::is_arithmetic<T>::value, T>::type a, T b) : a(0), b(1) {
         if (b == 0)
             throw std::out_of_range("Divide by zero exception");
 
+        if constexpr (std::is_integral<T>::value) {
+            if (!FitsInline(a) || !FitsInline(b)) {
+                *this = Rational(ToBigInteger(a), ToBigInteger(b));
+                return;
+            }
+        }
+
+        this->a = static_cast<long long>(a);
+        this->b = static_cast<long long>(b);
         Reduce();
     }
 
     template<typename T>
     explicit operator typename std::enable_if<std::is_integral<T>::value, T>::type() {
+        if (big)
+            return static_cast<T>((big->a / big->b).ToLongLong());
+
         if (std::is_integral<T>::value)
             return static_cast<T>(a / b);
 
@@ -28,6 +65,9 @@ public:
             return static_cast<T>(static_cast<double>(a) / b);
     }
 
+    BigInteger Numerator() const;
+    BigInteger Denominator() const;
+
     Rational& operator++();
     Rational operator++(int);
     Rational& operator--();
@@ -54,6 +94,10 @@ public:
     friend bool operator>=(const Rational& first, const Rational& second);
 
     friend std::ostream& operator<<(std::ostream& out, const Rational& r);
+    // Appends the reduced value as "a/b", or "a" for integers, used by the matrix and polynomial printers
+    friend void AppendText(std::string& out, const Rational& r);
+    // Reads "a/b" or "a", numerators and denominators too long for long long become BigInteger
+    friend bool ParseText(std::string_view token, Rational& r);
 
     // To resolve multiple condidates issue
 public:
@@ -140,9 +184,43 @@ public:
     }
 
 private:
+    struct BigFraction {
+        BigInteger a, b;
+    };
+
     long long a, b;
+    // Set when the value does not fit inline, a and b are unused then. Shared, as it is never modified.
+    std::shared_ptr<const BigFraction> big;
+
+    // LLONG_MIN is kept out of the inline form so that negating it never overflows, as are unsigned values above LLONG_MAX
+    template<typename T>
+    static bool FitsInline(T x) {
+        if constexpr (std::is_signed<T>::value)
+            return x > LLONG_MIN && x <= LLONG_MAX;
+        else
+            return x <= static_cast<unsigned long long>(LLONG_MAX);
+    }
+
+    template<typename T>
+    static BigInteger ToBigInteger(T x) {
+        bool negative = false;
+        unsigned long long magnitude = static_cast<unsigned long long>(x);
+        if constexpr (std::is_signed<T>::value) {
+            if (x < 0) {
+                negative = true;
+                magnitude = 0 - magnitude;
+            }
+        }
+
+        return BigInteger(negative, { static_cast<uint32_t>(magnitude), static_cast<uint32_t>(magnitude >> 32) });
+    }
 
     void Reduce();
+    Rational Reduced() const;
+    int Sign() const;
+
+    // -1, 0 or 1 like first - second, without building it
+    static int Compare(const Rational& first, const Rational& second);
 };
 
 namespace std {
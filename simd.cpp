@@ -0,0 +1,373 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ALGEBRA_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Portable kernels, also used for the tails of the vector loops
+	template<typename T>
+	void AxpyScalar(size_t n, T a, const T* x, T* y)
+	{
+		for (size_t i = 0; i < n; ++i)
+			y[i] += a * x[i];
+	}
+
+	template<typename T>
+	void AddScalar(size_t n, const T* a, const T* b, T* c)
+	{
+		for (size_t i = 0; i < n; ++i)
+			c[i] = a[i] + b[i];
+	}
+
+	template<typename T>
+	void SubtractScalar(size_t n, const T* a, const T* b, T* c)
+	{
+		for (size_t i = 0; i < n; ++i)
+			c[i] = a[i] - b[i];
+	}
+
+#ifdef ALGEBRA_SIMD_X86
+
+#define ALGEBRA_SIMD_ELEMENTWISE(NAME, TARGET, T, W, LOAD, STORE, ADD, SUB) \
+	__attribute__((target(TARGET))) void Add##NAME(size_t n, const T* a, const T* b, T* c) \
+	{ \
+		size_t i = 0; \
+		for (; i + W <= n; i += W) \
+			STORE(c + i, ADD(LOAD(a + i), LOAD(b + i))); \
+		AddScalar(n - i, a + i, b + i, c + i); \
+	} \
+	__attribute__((target(TARGET))) void Subtract##NAME(size_t n, const T* a, const T* b, T* c) \
+	{ \
+		size_t i = 0; \
+		for (; i + W <= n; i += W) \
+			STORE(c + i, SUB(LOAD(a + i), LOAD(b + i))); \
+		SubtractScalar(n - i, a + i, b + i, c + i); \
+	}
+
+#define ALGEBRA_SIMD_AXPY(NAME, TARGET, T, W, LOAD, STORE, ADD, MUL, SET1) \
+	__attribute__((target(TARGET))) void Axpy##NAME(size_t n, T a, const T* x, T* y) \
+	{ \
+		const auto va = SET1(a); \
+		size_t i = 0; \
+		for (; i + W <= n; i += W) \
+			STORE(y + i, ADD(LOAD(y + i), MUL(va, LOAD(x + i)))); \
+		AxpyScalar(n - i, a, x + i, y + i); \
+	}
+
+#define ALGEBRA_LOAD128(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+#define ALGEBRA_STORE128(p, v) _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v)
+#define ALGEBRA_LOAD256(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+#define ALGEBRA_STORE256(p, v) _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v)
+#define ALGEBRA_LOAD512(p) _mm512_loadu_si512(p)
+#define ALGEBRA_STORE512(p, v) _mm512_storeu_si512(p, v)
+
+	ALGEBRA_SIMD_ELEMENTWISE(Sse2Double, "sse2", double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, _mm_sub_pd)
+	ALGEBRA_SIMD_ELEMENTWISE(Sse2Float, "sse2", float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps)
+	ALGEBRA_SIMD_ELEMENTWISE(Sse2Int, "sse2", int, 4, ALGEBRA_LOAD128, ALGEBRA_STORE128, _mm_add_epi32, _mm_sub_epi32)
+	ALGEBRA_SIMD_ELEMENTWISE(Sse2Long, "sse2", long long, 2, ALGEBRA_LOAD128, ALGEBRA_STORE128, _mm_add_epi64, _mm_sub_epi64)
+	ALGEBRA_SIMD_AXPY(Sse2Double, "sse2", double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, _mm_mul_pd, _mm_set1_pd)
+	ALGEBRA_SIMD_AXPY(Sse2Float, "sse2", float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_mul_ps, _mm_set1_ps)
+
+	ALGEBRA_SIMD_ELEMENTWISE(Avx2Double, "avx2", double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, _mm256_sub_pd)
+	ALGEBRA_SIMD_ELEMENTWISE(Avx2Float, "avx2", float, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_sub_ps)
+	ALGEBRA_SIMD_ELEMENTWISE(Avx2Int, "avx2", int, 8, ALGEBRA_LOAD256, ALGEBRA_STORE256, _mm256_add_epi32, _mm256_sub_epi32)
+	ALGEBRA_SIMD_ELEMENTWISE(Avx2Long, "avx2", long long, 4, ALGEBRA_LOAD256, ALGEBRA_STORE256, _mm256_add_epi64, _mm256_sub_epi64)
+	ALGEBRA_SIMD_AXPY(Avx2Double, "avx2,fma", double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, _mm256_mul_pd, _mm256_set1_pd)
+	ALGEBRA_SIMD_AXPY(Avx2Float, "avx2,fma", float, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_mul_ps, _mm256_set1_ps)
+	ALGEBRA_SIMD_AXPY(Avx2Int, "avx2", int, 8, ALGEBRA_LOAD256, ALGEBRA_STORE256, _mm256_add_epi32, _mm256_mullo_epi32, _mm256_set1_epi32)
+
+	ALGEBRA_SIMD_ELEMENTWISE(Avx512Double, "avx512f", double, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_add_pd, _mm512_sub_pd)
+	ALGEBRA_SIMD_ELEMENTWISE(Avx512Float, "avx512f", float, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_sub_ps)
+	ALGEBRA_SIMD_ELEMENTWISE(Avx512Int, "avx512f", int, 16, ALGEBRA_LOAD512, ALGEBRA_STORE512, _mm512_add_epi32, _mm512_sub_epi32)
+	ALGEBRA_SIMD_ELEMENTWISE(Avx512Long, "avx512f", long long, 8, ALGEBRA_LOAD512, ALGEBRA_STORE512, _mm512_add_epi64, _mm512_sub_epi64)
+	ALGEBRA_SIMD_AXPY(Avx512Double, "avx512f", double, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_add_pd, _mm512_mul_pd, _mm512_set1_pd)
+	ALGEBRA_SIMD_AXPY(Avx512Float, "avx512f", float, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_mul_ps, _mm512_set1_ps)
+	ALGEBRA_SIMD_AXPY(Avx512Int, "avx512f", int, 16, ALGEBRA_LOAD512, ALGEBRA_STORE512, _mm512_add_epi32, _mm512_mullo_epi32, _mm512_set1_epi32)
+	ALGEBRA_SIMD_AXPY(Avx512Long, "avx512f,avx512dq", long long, 8, ALGEBRA_LOAD512, ALGEBRA_STORE512, _mm512_add_epi64, _mm512_mullo_epi64, _mm512_set1_epi64)
+
+	// Adds an MR x NR tile of accumulators, written row by row into acc, to c
+	template<typename T>
+	void StoreTile(const T* acc, size_t nrFull, T* c, size_t ldc, size_t mr, size_t nr)
+	{
+		for (size_t i = 0; i < mr; ++i)
+			for (size_t j = 0; j < nr; ++j)
+				c[i * ldc + j] += acc[i * nrFull + j];
+	}
+
+	// 4 x 8 doubles in 8 ymm accumulators
+	__attribute__((target("avx2,fma"))) void GemmMicroKernelAvx2(size_t kc, const double* a, const double* b, double* c, size_t ldc, size_t mr, size_t nr)
+	{
+		__m256d acc[4][2];
+		for (auto& i : acc)
+			i[0] = i[1] = _mm256_setzero_pd();
+
+		for (size_t p = 0; p < kc; ++p, a += 4, b += 8)
+		{
+			const __m256d b0 = _mm256_loadu_pd(b), b1 = _mm256_loadu_pd(b + 4);
+			for (size_t i = 0; i < 4; ++i)
+			{
+				const __m256d ai = _mm256_broadcast_sd(a + i);
+				acc[i][0] = _mm256_fmadd_pd(ai, b0, acc[i][0]);
+				acc[i][1] = _mm256_fmadd_pd(ai, b1, acc[i][1]);
+			}
+		}
+
+		if (mr == 4 && nr == 8)
+		{
+			for (size_t i = 0; i < 4; ++i)
+			{
+				double* ci = c + i * ldc;
+				_mm256_storeu_pd(ci, _mm256_add_pd(_mm256_loadu_pd(ci), acc[i][0]));
+				_mm256_storeu_pd(ci + 4, _mm256_add_pd(_mm256_loadu_pd(ci + 4), acc[i][1]));
+			}
+			return;
+		}
+
+		double tile[4 * 8];
+		for (size_t i = 0; i < 4; ++i)
+		{
+			_mm256_storeu_pd(tile + i * 8, acc[i][0]);
+			_mm256_storeu_pd(tile + i * 8 + 4, acc[i][1]);
+		}
+		StoreTile(tile, 8, c, ldc, mr, nr);
+	}
+
+	// 4 x 16 floats in 8 ymm accumulators
+	__attribute__((target("avx2,fma"))) void GemmMicroKernelAvx2(size_t kc, const float* a, const float* b, float* c, size_t ldc, size_t mr, size_t nr)
+	{
+		__m256 acc[4][2];
+		for (auto& i : acc)
+			i[0] = i[1] = _mm256_setzero_ps();
+
+		for (size_t p = 0; p < kc; ++p, a += 4, b += 16)
+		{
+			const __m256 b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8);
+			for (size_t i = 0; i < 4; ++i)
+			{
+				const __m256 ai = _mm256_broadcast_ss(a + i);
+				acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+				acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+			}
+		}
+
+		if (mr == 4 && nr == 16)
+		{
+			for (size_t i = 0; i < 4; ++i)
+			{
+				float* ci = c + i * ldc;
+				_mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), acc[i][0]));
+				_mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), acc[i][1]));
+			}
+			return;
+		}
+
+		float tile[4 * 16];
+		for (size_t i = 0; i < 4; ++i)
+		{
+			_mm256_storeu_ps(tile + i * 16, acc[i][0]);
+			_mm256_storeu_ps(tile + i * 16 + 8, acc[i][1]);
+		}
+		StoreTile(tile, 16, c, ldc, mr, nr);
+	}
+
+	// 4 x 8 doubles in 4 zmm accumulators
+	__attribute__((target("avx512f"))) void GemmMicroKernelAvx512(size_t kc, const double* a, const double* b, double* c, size_t ldc, size_t mr, size_t nr)
+	{
+		__m512d acc[4];
+		for (auto& i : acc)
+			i = _mm512_setzero_pd();
+
+		for (size_t p = 0; p < kc; ++p, a += 4, b += 8)
+		{
+			const __m512d b0 = _mm512_loadu_pd(b);
+			for (size_t i = 0; i < 4; ++i)
+				acc[i] = _mm512_fmadd_pd(_mm512_set1_pd(a[i]), b0, acc[i]);
+		}
+
+		if (mr == 4 && nr == 8)
+		{
+			for (size_t i = 0; i < 4; ++i)
+				_mm512_storeu_pd(c + i * ldc, _mm512_add_pd(_mm512_loadu_pd(c + i * ldc), acc[i]));
+			return;
+		}
+
+		double tile[4 * 8];
+		for (size_t i = 0; i < 4; ++i)
+			_mm512_storeu_pd(tile + i * 8, acc[i]);
+		StoreTile(tile, 8, c, ldc, mr, nr);
+	}
+
+	// 4 x 16 floats in 4 zmm accumulators
+	__attribute__((target("avx512f"))) void GemmMicroKernelAvx512(size_t kc, const float* a, const float* b, float* c, size_t ldc, size_t mr, size_t nr)
+	{
+		__m512 acc[4];
+		for (auto& i : acc)
+			i = _mm512_setzero_ps();
+
+		for (size_t p = 0; p < kc; ++p, a += 4, b += 16)
+		{
+			const __m512 b0 = _mm512_loadu_ps(b);
+			for (size_t i = 0; i < 4; ++i)
+				acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[i]), b0, acc[i]);
+		}
+
+		if (mr == 4 && nr == 16)
+		{
+			for (size_t i = 0; i < 4; ++i)
+				_mm512_storeu_ps(c + i * ldc, _mm512_add_ps(_mm512_loadu_ps(c + i * ldc), acc[i]));
+			return;
+		}
+
+		float tile[4 * 16];
+		for (size_t i = 0; i < 4; ++i)
+			_mm512_storeu_ps(tile + i * 16, acc[i]);
+		StoreTile(tile, 16, c, ldc, mr, nr);
+	}
+
+#endif
+
+	SimdLevel Detect()
+	{
+#ifdef ALGEBRA_SIMD_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+			return SimdLevel::AVX512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return SimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return SimdLevel::SSE2;
+#endif
+		return SimdLevel::Scalar;
+	}
+
+	std::atomic<SimdLevel>& Level()
+	{
+		static std::atomic<SimdLevel> level(DetectedSimdLevel());
+		return level;
+	}
+}
+
+SimdLevel DetectedSimdLevel()
+{
+	static const SimdLevel detected = Detect();
+	return detected;
+}
+
+SimdLevel CurrentSimdLevel()
+{
+	return Level().load(std::memory_order_relaxed);
+}
+
+void SetSimdLevel(SimdLevel level)
+{
+	Level().store(std::min(level, DetectedSimdLevel()), std::memory_order_relaxed);
+}
+
+#ifdef ALGEBRA_SIMD_X86
+#define ALGEBRA_SIMD_DISPATCH(CALL_AVX512, CALL_AVX2, CALL_SSE2, CALL_SCALAR) \
+	switch (CurrentSimdLevel()) \
+	{ \
+	case SimdLevel::AVX512: CALL_AVX512; return; \
+	case SimdLevel::AVX2: CALL_AVX2; return; \
+	case SimdLevel::SSE2: CALL_SSE2; return; \
+	default: CALL_SCALAR; return; \
+	}
+#else
+#define ALGEBRA_SIMD_DISPATCH(CALL_AVX512, CALL_AVX2, CALL_SSE2, CALL_SCALAR) CALL_SCALAR;
+#endif
+
+void SimdAxpy(size_t n, double a, const double* x, double* y)
+{
+	ALGEBRA_SIMD_DISPATCH(AxpyAvx512Double(n, a, x, y), AxpyAvx2Double(n, a, x, y), AxpySse2Double(n, a, x, y), AxpyScalar(n, a, x, y))
+}
+
+void SimdAxpy(size_t n, float a, const float* x, float* y)
+{
+	ALGEBRA_SIMD_DISPATCH(AxpyAvx512Float(n, a, x, y), AxpyAvx2Float(n, a, x, y), AxpySse2Float(n, a, x, y), AxpyScalar(n, a, x, y))
+}
+
+void SimdAxpy(size_t n, int a, const int* x, int* y)
+{
+	// 32-bit multiplication needs SSE4.1, so there is no SSE2 kernel
+	ALGEBRA_SIMD_DISPATCH(AxpyAvx512Int(n, a, x, y), AxpyAvx2Int(n, a, x, y), AxpyScalar(n, a, x, y), AxpyScalar(n, a, x, y))
+}
+
+void SimdAxpy(size_t n, long long a, const long long* x, long long* y)
+{
+	// 64-bit multiplication only exists in AVX-512DQ
+	ALGEBRA_SIMD_DISPATCH(AxpyAvx512Long(n, a, x, y), AxpyScalar(n, a, x, y), AxpyScalar(n, a, x, y), AxpyScalar(n, a, x, y))
+}
+
+void SimdAdd(size_t n, const double* a, const double* b, double* c)
+{
+	ALGEBRA_SIMD_DISPATCH(AddAvx512Double(n, a, b, c), AddAvx2Double(n, a, b, c), AddSse2Double(n, a, b, c), AddScalar(n, a, b, c))
+}
+
+void SimdAdd(size_t n, const float* a, const float* b, float* c)
+{
+	ALGEBRA_SIMD_DISPATCH(AddAvx512Float(n, a, b, c), AddAvx2Float(n, a, b, c), AddSse2Float(n, a, b, c), AddScalar(n, a, b, c))
+}
+
+void SimdAdd(size_t n, const int* a, const int* b, int* c)
+{
+	ALGEBRA_SIMD_DISPATCH(AddAvx512Int(n, a, b, c), AddAvx2Int(n, a, b, c), AddSse2Int(n, a, b, c), AddScalar(n, a, b, c))
+}
+
+void SimdAdd(size_t n, const long long* a, const long long* b, long long* c)
+{
+	ALGEBRA_SIMD_DISPATCH(AddAvx512Long(n, a, b, c), AddAvx2Long(n, a, b, c), AddSse2Long(n, a, b, c), AddScalar(n, a, b, c))
+}
+
+void SimdSubtract(size_t n, const double* a, const double* b, double* c)
+{
+	ALGEBRA_SIMD_DISPATCH(SubtractAvx512Double(n, a, b, c), SubtractAvx2Double(n, a, b, c), SubtractSse2Double(n, a, b, c), SubtractScalar(n, a, b, c))
+}
+
+void SimdSubtract(size_t n, const float* a, const float* b, float* c)
+{
+	ALGEBRA_SIMD_DISPATCH(SubtractAvx512Float(n, a, b, c), SubtractAvx2Float(n, a, b, c), SubtractSse2Float(n, a, b, c), SubtractScalar(n, a, b, c))
+}
+
+void SimdSubtract(size_t n, const int* a, const int* b, int* c)
+{
+	ALGEBRA_SIMD_DISPATCH(SubtractAvx512Int(n, a, b, c), SubtractAvx2Int(n, a, b, c), SubtractSse2Int(n, a, b, c), SubtractScalar(n, a, b, c))
+}
+
+void SimdSubtract(size_t n, const long long* a, const long long* b, long long* c)
+{
+	ALGEBRA_SIMD_DISPATCH(SubtractAvx512Long(n, a, b, c), SubtractAvx2Long(n, a, b, c), SubtractSse2Long(n, a, b, c), SubtractScalar(n, a, b, c))
+}
+
+bool SimdGemmMicroKernel(size_t kc, const double* a, const double* b, double* c, size_t ldc, size_t mr, size_t nr)
+{
+#ifdef ALGEBRA_SIMD_X86
+	switch (CurrentSimdLevel())
+	{
+	case SimdLevel::AVX512: GemmMicroKernelAvx512(kc, a, b, c, ldc, mr, nr); return true;
+	case SimdLevel::AVX2: GemmMicroKernelAvx2(kc, a, b, c, ldc, mr, nr); return true;
+	default: return false;
+	}
+#else
+	return false;
+#endif
+}
+
+bool SimdGemmMicroKernel(size_t kc, const float* a, const float* b, float* c, size_t ldc, size_t mr, size_t nr)
+{
+#ifdef ALGEBRA_SIMD_X86
+	switch (CurrentSimdLevel())
+	{
+	case SimdLevel::AVX512: GemmMicroKernelAvx512(kc, a, b, c, ldc, mr, nr); return true;
+	case SimdLevel::AVX2: GemmMicroKernelAvx2(kc, a, b, c, ldc, mr, nr); return true;
+	default: return false;
+	}
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+// Instruction sets the kernels below can run on. The best one supported by the CPU is detected on
+// first use, so the same binary runs everywhere. Only x86 with GCC/Clang has vector kernels.
+enum class SimdLevel
+{
+	Scalar,
+	SSE2,
+	AVX2,
+	AVX512
+};
+
+SimdLevel DetectedSimdLevel();
+SimdLevel CurrentSimdLevel();
+// Clamped to DetectedSimdLevel(), useful to compare the kernels against each other
+void SetSimdLevel(SimdLevel level);
+
+template<typename T>
+constexpr bool HasSimdKernels = std::is_same<T, double>::value || std::is_same<T, float>::value
+	|| std::is_same<T, int>::value || std::is_same<T, long long>::value;
+
+// y[i] += a * x[i]
+void SimdAxpy(size_t n, double a, const double* x, double* y);
+void SimdAxpy(size_t n, float a, const float* x, float* y);
+void SimdAxpy(size_t n, int a, const int* x, int* y);
+void SimdAxpy(size_t n, long long a, const long long* x, long long* y);
+
+// c[i] = a[i] + b[i], c may be a or b
+void SimdAdd(size_t n, const double* a, const double* b, double* c);
+void SimdAdd(size_t n, const float* a, const float* b, float* c);
+void SimdAdd(size_t n, const int* a, const int* b, int* c);
+void SimdAdd(size_t n, const long long* a, const long long* b, long long* c);
+
+// c[i] = a[i] - b[i], c may be a or b
+void SimdSubtract(size_t n, const double* a, const double* b, double* c);
+void SimdSubtract(size_t n, const float* a, const float* b, float* c);
+void SimdSubtract(size_t n, const int* a, const int* b, int* c);
+void SimdSubtract(size_t n, const long long* a, const long long* b, long long* c);
+
+// GEMM micro-kernel on packed slivers, see GemmMicroKernel in gemm.h: a is kc x 4, b is kc x 8 (double) or kc x 16 (float).
+// Uses FMA, so the last bits may differ from the portable kernel. Returns false if there is no vector kernel for this CPU.
+bool SimdGemmMicroKernel(size_t kc, const double* a, const double* b, double* c, size_t ldc, size_t mr, size_t nr);
+bool SimdGemmMicroKernel(size_t kc, const float* a, const float* b, float* c, size_t ldc, size_t mr, size_t nr);
+
+template<typename T>
+void Axpy(size_t n, const T& a, const T* x, T* y)
+{
+	if constexpr (HasSimdKernels<T>)
+		SimdAxpy(n, a, x, y);
+	else
+		for (size_t i = 0; i < n; ++i)
+			y[i] += a * x[i];
+}
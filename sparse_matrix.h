@@ -0,0 +1,441 @@
+#pragma once
+
+#include "matrix.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The Markowitz search looks at this many of the shortest columns for the pivot of least (r - 1)(c - 1)
+constexpr size_t SparseMarkowitzColumns = 4;
+// Floating point pivots must be at least this fraction of the largest entry of their column
+constexpr double SparsePivotThreshold = 0.1;
+// Floating point fill below this many ulps of the terms it came from is cancellation noise and dropped
+constexpr double SparseDropUlps = 64;
+
+// Row echelon form of a sparse matrix, as produced by SparseMatrix::Echelon().
+// Pivot k sits in column pivotColumns[k] of row pivotRows[k]; that row only has entries in its own pivot column,
+// in pivot columns of later pivots and in free columns, so the system is triangular in reverse pivot order.
+template<typename T>
+struct SparseEchelonForm {
+	size_t width = 0;
+	std::vector<size_t> pivotColumns;
+	std::vector<std::vector<std::pair<size_t, T>>> pivotRows;
+};
+
+// Compressed sparse row matrix. The compressed sparse column form of A is the CSR form of A.Transposed().
+template<typename T>
+class SparseMatrix {
+public:
+	SparseMatrix() : height(0), width(0), rowStarts(1, 0) {}
+	SparseMatrix(size_t height, size_t width) : height(height), width(width), rowStarts(height + 1, 0) {}
+	// Entries are (row, column, value); repeated positions are summed up and zeros dropped
+	SparseMatrix(size_t height, size_t width, std::vector<std::tuple<size_t, size_t, T>> entries) : height(height), width(width), rowStarts(height + 1, 0) {
+		std::sort(entries.begin(), entries.end(), [](const auto& first, const auto& second) {
+			return std::tie(std::get<0>(first), std::get<1>(first)) < std::tie(std::get<0>(second), std::get<1>(second));
+		});
+
+		for (size_t k = 0; k < entries.size();) {
+			const auto [i, j, value] = entries[k];
+			if (i >= height || j >= width) {
+				throw UnsuitableMatrixSizes("SparseMatrix entry is out of range");
+			}
+
+			T sum = value;
+			for (++k; k < entries.size() && std::get<0>(entries[k]) == i && std::get<1>(entries[k]) == j; ++k) {
+				sum += std::get<2>(entries[k]);
+			}
+			if (sum != 0) {
+				columns.push_back(j);
+				values.push_back(sum);
+				++rowStarts[i + 1];
+			}
+		}
+
+		for (size_t i = 0; i < height; ++i) {
+			rowStarts[i + 1] += rowStarts[i];
+		}
+	}
+	explicit SparseMatrix(const Matrix<T>& dense) : height(dense.Height()), width(dense.Width()), rowStarts(1, 0) {
+		for (const auto& row : dense) {
+			for (size_t j = 0; j < width; ++j) {
+				if (row[j] != 0) {
+					columns.push_back(j);
+					values.push_back(row[j]);
+				}
+			}
+			rowStarts.push_back(columns.size());
+		}
+	}
+
+	Matrix<T> ToDense() const {
+		Matrix<T> result(height, width);
+		for (size_t i = 0; i < height; ++i) {
+			for (size_t k = rowStarts[i]; k < rowStarts[i + 1]; ++k) {
+				result[i][columns[k]] = values[k];
+			}
+		}
+
+		return result;
+	}
+
+	size_t Height() const {
+		return height;
+	}
+	size_t Width() const {
+		return width;
+	}
+	size_t NonZeros() const {
+		return values.size();
+	}
+
+	// Entries of row i are columns[k], values[k] for k in [rowStarts[i], rowStarts[i + 1]), sorted by column
+	const std::vector<size_t>& RowStarts() const {
+		return rowStarts;
+	}
+	const std::vector<size_t>& Columns() const {
+		return columns;
+	}
+	const std::vector<T>& Values() const {
+		return values;
+	}
+
+	T operator()(size_t i, size_t j) const {
+		auto first = columns.begin() + rowStarts[i], last = columns.begin() + rowStarts[i + 1];
+		auto it = std::lower_bound(first, last, j);
+		return (it != last && *it == j ? values[it - columns.begin()] : T{ 0 });
+	}
+
+	SparseMatrix Transposed() const {
+		SparseMatrix result(width, height);
+		for (size_t j : columns) {
+			++result.rowStarts[j + 1];
+		}
+		for (size_t j = 0; j < width; ++j) {
+			result.rowStarts[j + 1] += result.rowStarts[j];
+		}
+
+		result.columns.resize(values.size());
+		result.values.resize(values.size());
+		std::vector<size_t> next(result.rowStarts.begin(), result.rowStarts.end() - 1);
+		for (size_t i = 0; i < height; ++i) {
+			for (size_t k = rowStarts[i]; k < rowStarts[i + 1]; ++k) {
+				size_t position = next[columns[k]]++;
+				result.columns[position] = i;
+				result.values[position] = values[k];
+			}
+		}
+
+		return result;
+	}
+
+	friend Matrix<T> operator*(const SparseMatrix& first, const Matrix<T>& second) {
+		if (first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.Height(), second.Width());
+		ParallelFor(0, first.Height(), RowGrain(second.Width()), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k = first.rowStarts[i]; k < first.rowStarts[i + 1]; ++k) {
+					Axpy(second.Width(), first.values[k], second[first.columns[k]].begin(), result[i].begin());
+				}
+			}
+		});
+
+		return result;
+	}
+	friend Matrix<T> operator*(const Matrix<T>& first, const SparseMatrix& second) {
+		if (first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.Height(), second.Width());
+		ParallelFor(0, first.Height(), RowGrain(second.NonZeros() / std::max<size_t>(second.Height(), 1) + 1), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t j = 0; j < first.Width(); ++j) {
+					const T d = first[i][j];
+					if (d == 0) {
+						continue;
+					}
+					for (size_t k = second.rowStarts[j]; k < second.rowStarts[j + 1]; ++k) {
+						result[i][second.columns[k]] += d * second.values[k];
+					}
+				}
+			}
+		});
+
+		return result;
+	}
+	// Gustavson's algorithm: every row of the result is accumulated in a dense buffer
+	friend SparseMatrix operator*(const SparseMatrix& first, const SparseMatrix& second) {
+		if (first.Width() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		std::vector<std::vector<std::pair<size_t, T>>> rows(first.Height());
+		ParallelFor(0, first.Height(), 64, [&](size_t lo, size_t hi) {
+			std::vector<T> accumulator(second.Width());
+			std::vector<bool> used(second.Width());
+			std::vector<size_t> touched;
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k1 = first.rowStarts[i]; k1 < first.rowStarts[i + 1]; ++k1) {
+					const size_t j1 = first.columns[k1];
+					for (size_t k2 = second.rowStarts[j1]; k2 < second.rowStarts[j1 + 1]; ++k2) {
+						const size_t j = second.columns[k2];
+						if (!used[j]) {
+							used[j] = true;
+							touched.push_back(j);
+						}
+						accumulator[j] += first.values[k1] * second.values[k2];
+					}
+				}
+
+				std::sort(touched.begin(), touched.end());
+				for (size_t j : touched) {
+					if (accumulator[j] != 0) {
+						rows[i].emplace_back(j, accumulator[j]);
+					}
+					accumulator[j] = T{ 0 };
+					used[j] = false;
+				}
+				touched.clear();
+			}
+		});
+
+		return FromRows(first.Height(), second.Width(), rows);
+	}
+
+	// Sparse Gaussian elimination over a field with Markowitz pivoting: among the entries of the SparseMarkowitzColumns
+	// shortest active columns, the pivot is the one with the least (r - 1)(c - 1), r and c being the entries left in its
+	// row and column, which bounds the fill-in of the step. Floating point types only accept entries of at least
+	// SparsePivotThreshold times the largest in their column and drop results that cancel down to rounding noise.
+	// Integers are eliminated fraction-free: a row becomes a * row - b * pivot row with the smallest such a, b and is
+	// then divided by the gcd of its entries, so pivots are not normalized to 1.
+	SparseEchelonForm<T> Echelon() const {
+		static_assert(IsField<T> || std::is_integral<T>::value, "Echelon needs an element type with division or an integer type");
+		std::vector<std::vector<std::pair<size_t, T>>> rows(height);
+		std::vector<std::vector<size_t>> columnRows(width);
+		std::vector<size_t> columnCount(width, 0);
+		for (size_t i = 0; i < height; ++i) {
+			for (size_t k = rowStarts[i]; k < rowStarts[i + 1]; ++k) {
+				rows[i].emplace_back(columns[k], values[k]);
+				columnRows[columns[k]].push_back(i);
+				++columnCount[columns[k]];
+			}
+		}
+
+		using Candidate = std::pair<size_t, size_t>;
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+		for (size_t j = 0; j < width; ++j) {
+			if (columnCount[j]) {
+				queue.emplace(columnCount[j], j);
+			}
+		}
+
+		SparseEchelonForm<T> result;
+		result.width = width;
+		std::vector<bool> activeRow(height, true), doneColumn(width, false);
+		std::vector<size_t> seen(height, SIZE_MAX), searchedAt(width, SIZE_MAX), searched, touchedColumns;
+		std::vector<std::pair<size_t, T>> merged;
+		for (size_t step = 0; !queue.empty(); ++step) {
+			// Markowitz search over the shortest columns; columnRows of a searched column is compacted to its active rows
+			size_t bestCost = SIZE_MAX, r = SIZE_MAX, c = SIZE_MAX;
+			searched.clear();
+			while (!queue.empty() && searched.size() < SparseMarkowitzColumns && bestCost != 0) {
+				const auto [count, j] = queue.top();
+				queue.pop();
+				if (doneColumn[j] || count != columnCount[j] || count == 0 || searchedAt[j] == step) {
+					continue;
+				}
+				searchedAt[j] = step;
+
+				// Rows still having an entry in column j, columnRows may hold stale or repeated ones
+				std::vector<size_t>& candidates = columnRows[j];
+				size_t kept = 0;
+				for (size_t k = 0; k < candidates.size(); ++k) {
+					const size_t i = candidates[k];
+					if (activeRow[i] && seen[i] != j && Find(rows[i], j) != rows[i].end()) {
+						seen[i] = j;
+						candidates[kept++] = i;
+					}
+				}
+				candidates.resize(kept);
+				for (size_t i : candidates) {
+					seen[i] = SIZE_MAX;
+				}
+				columnCount[j] = kept;
+				if (kept == 0) {
+					continue;
+				}
+				searched.push_back(j);
+
+				T threshold{ 0 };
+				if constexpr (std::is_floating_point<T>::value) {
+					for (size_t i : candidates) {
+						threshold = std::max(threshold, std::abs(Find(rows[i], j)->second));
+					}
+					threshold *= static_cast<T>(SparsePivotThreshold);
+				}
+				for (size_t i : candidates) {
+					if constexpr (std::is_floating_point<T>::value) {
+						if (std::abs(Find(rows[i], j)->second) < threshold) {
+							continue;
+						}
+					}
+					const size_t cost = (rows[i].size() - 1) * (kept - 1);
+					if (cost < bestCost) {
+						bestCost = cost;
+						r = i;
+						c = j;
+					}
+				}
+			}
+			if (c == SIZE_MAX) {
+				continue;
+			}
+			for (size_t j : searched) {
+				if (j != c) {
+					queue.emplace(columnCount[j], j);
+				}
+			}
+
+			std::vector<size_t> candidates;
+			std::swap(candidates, columnRows[c]);
+
+			doneColumn[c] = true;
+			activeRow[r] = false;
+			touchedColumns.clear();
+			for (const auto& [j, value] : rows[r]) {
+				--columnCount[j];
+				touchedColumns.push_back(j);
+			}
+
+			const T pivot = Find(rows[r], c)->second;
+			T inverse{ 1 };
+			if constexpr (!std::is_integral<T>::value) {
+				inverse = 1 / pivot;
+			}
+			for (size_t i : candidates) {
+				if (i == r) {
+					continue;
+				}
+
+				// rows[i] = scale * rows[i] - f * rows[r], column c is dropped exactly
+				T scale{ 1 }, f = Find(rows[i], c)->second;
+				if constexpr (std::is_integral<T>::value) {
+					const T g = std::gcd(pivot, f);
+					scale = pivot / g;
+					f /= g;
+				}
+				else {
+					f *= inverse;
+				}
+				merged.clear();
+				auto it1 = rows[i].begin(), it2 = rows[r].begin();
+				while (it1 != rows[i].end() || it2 != rows[r].end()) {
+					if (it2 == rows[r].end() || (it1 != rows[i].end() && it1->first < it2->first)) {
+						merged.emplace_back(it1->first, scale * it1->second);
+						++it1;
+					}
+					else if (it1 == rows[i].end() || it2->first < it1->first) {
+						merged.emplace_back(it2->first, -f * it2->second);
+						columnRows[it2->first].push_back(i);
+						++columnCount[it2->first];
+						++it2;
+					}
+					else {
+						const T first = scale * it1->second, second = f * it2->second, value = first - second;
+						if (it1->first != c && value != 0 && !IsCancellation(value, first, second)) {
+							merged.emplace_back(it1->first, value);
+						}
+						else {
+							--columnCount[it1->first];
+						}
+						++it1;
+						++it2;
+					}
+				}
+				if constexpr (std::is_integral<T>::value) {
+					T g{ 0 };
+					for (const auto& [j, value] : merged) {
+						g = std::gcd(g, value);
+					}
+					if (g > 1) {
+						for (auto& [j, value] : merged) {
+							value /= g;
+						}
+					}
+				}
+				std::swap(rows[i], merged);
+			}
+
+			for (size_t j : touchedColumns) {
+				if (!doneColumn[j] && columnCount[j]) {
+					queue.emplace(columnCount[j], j);
+				}
+			}
+
+			result.pivotColumns.push_back(c);
+			result.pivotRows.push_back(std::move(rows[r]));
+		}
+
+		return result;
+	}
+
+	size_t Rank() const {
+		return Echelon().pivotColumns.size();
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const SparseMatrix& m) {
+		return out << m.ToDense();
+	}
+
+private:
+	size_t height, width;
+	std::vector<size_t> rowStarts;
+	std::vector<size_t> columns;
+	std::vector<T> values;
+
+	static size_t RowGrain(size_t rowCost) {
+		return std::max<size_t>(1, (1 << 14) / std::max<size_t>(rowCost, 1));
+	}
+
+	// value = first - second lost everything but rounding errors
+	static bool IsCancellation(const T& value, const T& first, const T& second) {
+		if constexpr (std::is_floating_point<T>::value) {
+			return std::abs(value) <= SparseDropUlps * std::numeric_limits<T>::epsilon() * (std::abs(first) + std::abs(second));
+		}
+		else {
+			return false;
+		}
+	}
+
+	static typename std::vector<std::pair<size_t, T>>::iterator Find(std::vector<std::pair<size_t, T>>& row, size_t j) {
+		auto it = std::lower_bound(row.begin(), row.end(), j, [](const auto& entry, size_t j) { return entry.first < j; });
+		return (it != row.end() && it->first == j ? it : row.end());
+	}
+
+	static SparseMatrix FromRows(size_t height, size_t width, const std::vector<std::vector<std::pair<size_t, T>>>& rows) {
+		SparseMatrix result(height, width);
+		for (size_t i = 0; i < height; ++i) {
+			for (const auto& [j, value] : rows[i]) {
+				result.columns.push_back(j);
+				result.values.push_back(value);
+			}
+			result.rowStarts[i + 1] = result.columns.size();
+		}
+
+		return result;
+	}
+};
@@ -0,0 +1,708 @@
+#pragma once
+
+#include "matrix.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Square matrices that store only their nonzero structure. Combined with a dense Matrix they never
+// expand themselves: products cost O(n^2) for a diagonal, about half of a dense product for a triangle
+// and O(n * bandwidth) per column for a band, and solves are a substitution instead of an elimination.
+
+template<typename T>
+class DiagonalMatrix {
+public:
+	DiagonalMatrix() = default;
+	explicit DiagonalMatrix(size_t n) : diagonal(n) {}
+	explicit DiagonalMatrix(std::vector<T> diagonal) : diagonal(std::move(diagonal)) {}
+	// Keeps only the diagonal of A
+	explicit DiagonalMatrix(const Matrix<T>& A) : diagonal(A.Height()) {
+		if (A.Height() != A.Width()) {
+			throw UnsuitableMatrixSizes("DiagonalMatrix must take squere matrix");
+		}
+		for (size_t i = 0; i < Size(); ++i) {
+			diagonal[i] = A[i][i];
+		}
+	}
+
+	size_t Size() const {
+		return diagonal.size();
+	}
+	size_t Height() const {
+		return Size();
+	}
+	size_t Width() const {
+		return Size();
+	}
+
+	std::vector<T>& Diagonal() {
+		return diagonal;
+	}
+	const std::vector<T>& Diagonal() const {
+		return diagonal;
+	}
+
+	T operator()(size_t i, size_t j) const {
+		return (i == j ? diagonal[i] : T{});
+	}
+
+	Matrix<T> ToMatrix() const {
+		Matrix<T> result(Size(), Size());
+		for (size_t i = 0; i < Size(); ++i) {
+			result[i][i] = diagonal[i];
+		}
+
+		return result;
+	}
+
+	T Det() const {
+		T result{ 1 };
+		for (const T& x : diagonal) {
+			result *= x;
+		}
+
+		return result;
+	}
+
+	DiagonalMatrix Inverse() const {
+		static_assert(IsField<T>, "Inverse needs an element type with division");
+		DiagonalMatrix result(Size());
+		for (size_t i = 0; i < Size(); ++i) {
+			if (diagonal[i] == 0) {
+				throw std::runtime_error("Degenerate matrix");
+			}
+			result.diagonal[i] = 1 / diagonal[i];
+		}
+
+		return result;
+	}
+
+	// X with DX = B
+	Matrix<T> Solve(Matrix<T> b) const {
+		return Inverse() * std::move(b);
+	}
+
+	friend DiagonalMatrix operator+(DiagonalMatrix first, const DiagonalMatrix& second) {
+		first.CheckSize(second.Size(), "operator+ must take two matrices of the same length");
+		for (size_t i = 0; i < first.Size(); ++i) {
+			first.diagonal[i] += second.diagonal[i];
+		}
+
+		return first;
+	}
+	friend DiagonalMatrix operator-(DiagonalMatrix first, const DiagonalMatrix& second) {
+		first.CheckSize(second.Size(), "operator- must take two matrices of the same length");
+		for (size_t i = 0; i < first.Size(); ++i) {
+			first.diagonal[i] -= second.diagonal[i];
+		}
+
+		return first;
+	}
+	friend DiagonalMatrix operator*(DiagonalMatrix first, const DiagonalMatrix& second) {
+		first.CheckSize(second.Size(), "operator* must take two matrices of the same length");
+		for (size_t i = 0; i < first.Size(); ++i) {
+			first.diagonal[i] *= second.diagonal[i];
+		}
+
+		return first;
+	}
+
+	// In pair with Matrix
+public:
+	friend Matrix<T> operator+(Matrix<T> first, const DiagonalMatrix& second) {
+		second.CheckSize(first, "operator+ must take two matrices of the same length");
+		for (size_t i = 0; i < second.Size(); ++i) {
+			first[i][i] += second.diagonal[i];
+		}
+
+		return first;
+	}
+	friend Matrix<T> operator+(const DiagonalMatrix& first, Matrix<T> second) {
+		return std::move(second) + first;
+	}
+	friend Matrix<T> operator-(Matrix<T> first, const DiagonalMatrix& second) {
+		second.CheckSize(first, "operator- must take two matrices of the same length");
+		for (size_t i = 0; i < second.Size(); ++i) {
+			first[i][i] -= second.diagonal[i];
+		}
+
+		return first;
+	}
+	friend Matrix<T> operator-(const DiagonalMatrix& first, Matrix<T> second) {
+		return first + (-std::move(second));
+	}
+
+	// Scales the rows of second
+	friend Matrix<T> operator*(const DiagonalMatrix& first, Matrix<T> second) {
+		if (first.Size() != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		ParallelFor(0, second.Height(), RowGrain(second.Width()), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (T& x : second[i]) {
+					x = first.diagonal[i] * x;
+				}
+			}
+		});
+		return second;
+	}
+	// Scales the columns of first
+	friend Matrix<T> operator*(Matrix<T> first, const DiagonalMatrix& second) {
+		if (first.Width() != second.Size()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		ParallelFor(0, first.Height(), RowGrain(first.Width()), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t j = 0; j < first.Width(); ++j) {
+					first[i][j] *= second.diagonal[j];
+				}
+			}
+		});
+		return first;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const DiagonalMatrix& m) {
+		return out << m.ToMatrix();
+	}
+
+private:
+	std::vector<T> diagonal;
+
+	void CheckSize(size_t size, const char* message) const {
+		if (Size() != size) {
+			throw UnsuitableMatrixSizes(message);
+		}
+	}
+	void CheckSize(const Matrix<T>& m, const char* message) const {
+		if (Size() != m.Height() || Size() != m.Width()) {
+			throw UnsuitableMatrixSizes(message);
+		}
+	}
+
+	static size_t RowGrain(size_t width) {
+		return std::max<size_t>(1, (1 << 14) / std::max<size_t>(width, 1));
+	}
+};
+
+// Rows are packed one after another, each holding only its part of the triangle: columns i..n-1 of
+// row i for Upper, columns 0..i otherwise
+template<typename T, bool Upper>
+class TriangularMatrix {
+public:
+	TriangularMatrix() : n(0) {}
+	explicit TriangularMatrix(size_t n) : data(n * (n + 1) / 2), n(n) {}
+	// Keeps only the triangle of A
+	explicit TriangularMatrix(const Matrix<T>& A) : TriangularMatrix(A.Height()) {
+		if (A.Height() != A.Width()) {
+			throw UnsuitableMatrixSizes("TriangularMatrix must take squere matrix");
+		}
+		for (size_t i = 0; i < n; ++i) {
+			std::copy(A[i].begin() + First(i), A[i].begin() + Last(i), Row(i));
+		}
+	}
+
+	static TriangularMatrix E(size_t n) {
+		TriangularMatrix result(n);
+		for (size_t i = 0; i < n; ++i) {
+			result(i, i) = T{ 1 };
+		}
+
+		return result;
+	}
+
+	size_t Size() const {
+		return n;
+	}
+	size_t Height() const {
+		return n;
+	}
+	size_t Width() const {
+		return n;
+	}
+
+	// Columns [First(i), Last(i)) of row i are stored, starting at Row(i)
+	size_t First(size_t i) const {
+		return (Upper ? i : 0);
+	}
+	size_t Last(size_t i) const {
+		return (Upper ? n : i + 1);
+	}
+	T* Row(size_t i) {
+		return data.data() + Offset(i);
+	}
+	const T* Row(size_t i) const {
+		return data.data() + Offset(i);
+	}
+
+	T operator()(size_t i, size_t j) const {
+		return (First(i) <= j && j < Last(i) ? Row(i)[j - First(i)] : T{});
+	}
+	T& operator()(size_t i, size_t j) {
+		if (j < First(i) || Last(i) <= j) {
+			throw std::out_of_range("element is outside of the triangle");
+		}
+		return Row(i)[j - First(i)];
+	}
+
+	Matrix<T> ToMatrix() const {
+		Matrix<T> result(n, n);
+		for (size_t i = 0; i < n; ++i) {
+			std::copy(Row(i), Row(i) + (Last(i) - First(i)), result[i].begin() + First(i));
+		}
+
+		return result;
+	}
+
+	T Det() const {
+		T result{ 1 };
+		for (size_t i = 0; i < n; ++i) {
+			result *= (*this)(i, i);
+		}
+
+		return result;
+	}
+
+	// X with AX = B by substitution, from the last row for Upper and from the first one otherwise
+	Matrix<T> Solve(Matrix<T> b) const {
+		static_assert(IsField<T>, "Solve needs an element type with division");
+		if (b.Height() != n) {
+			throw UnsuitableMatrixSizes("Solve must take a right-hand side with the height of the matrix");
+		}
+
+		for (size_t step = 0; step < n; ++step) {
+			const size_t i = (Upper ? n - 1 - step : step);
+			const T& pivot = (*this)(i, i);
+			if (pivot == 0) {
+				throw std::runtime_error("Degenerate matrix");
+			}
+
+			for (size_t k = First(i); k < Last(i); ++k) {
+				if (k != i && !(Row(i)[k - First(i)] == 0)) {
+					Axpy(b.Width(), T{ -Row(i)[k - First(i)] }, b[k].begin(), b[i].begin());
+				}
+			}
+
+			const T d = 1 / pivot;
+			for (T& x : b[i]) {
+				x *= d;
+			}
+		}
+
+		return b;
+	}
+
+	TriangularMatrix Inverse() const {
+		return TriangularMatrix(Solve(Matrix<T>::E(n, n)));
+	}
+
+	friend TriangularMatrix operator+(TriangularMatrix first, const TriangularMatrix& second) {
+		first.CheckSize(second.n, "operator+ must take two matrices of the same length");
+		for (size_t k = 0; k < first.data.size(); ++k) {
+			first.data[k] += second.data[k];
+		}
+
+		return first;
+	}
+	friend TriangularMatrix operator-(TriangularMatrix first, const TriangularMatrix& second) {
+		first.CheckSize(second.n, "operator- must take two matrices of the same length");
+		for (size_t k = 0; k < first.data.size(); ++k) {
+			first.data[k] -= second.data[k];
+		}
+
+		return first;
+	}
+	// The product stays in the same triangle, row i of it only needs rows First(i)..Last(i) of second
+	friend TriangularMatrix operator*(const TriangularMatrix& first, const TriangularMatrix& second) {
+		first.CheckSize(second.n, "operator* must take two matrices of the same length");
+		TriangularMatrix result(first.n);
+		ParallelFor(0, first.n, RowGrain(first.n), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k = first.First(i); k < first.Last(i); ++k) {
+					const T& a = first.Row(i)[k - first.First(i)];
+					// Row k of second is inside the triangle of row i
+					const size_t from = std::max(second.First(k), result.First(i)), to = std::min(second.Last(k), result.Last(i));
+					if (from < to) {
+						Axpy(to - from, a, second.Row(k) + (from - second.First(k)), result.Row(i) + (from - result.First(i)));
+					}
+				}
+			}
+		});
+
+		return result;
+	}
+
+	// In pair with Matrix
+public:
+	friend Matrix<T> operator+(Matrix<T> first, const TriangularMatrix& second) {
+		second.CheckSize(first, "operator+ must take two matrices of the same length");
+		for (size_t i = 0; i < second.n; ++i) {
+			for (size_t j = second.First(i); j < second.Last(i); ++j) {
+				first[i][j] += second.Row(i)[j - second.First(i)];
+			}
+		}
+
+		return first;
+	}
+	friend Matrix<T> operator+(const TriangularMatrix& first, Matrix<T> second) {
+		return std::move(second) + first;
+	}
+	friend Matrix<T> operator-(Matrix<T> first, const TriangularMatrix& second) {
+		second.CheckSize(first, "operator- must take two matrices of the same length");
+		for (size_t i = 0; i < second.n; ++i) {
+			for (size_t j = second.First(i); j < second.Last(i); ++j) {
+				first[i][j] -= second.Row(i)[j - second.First(i)];
+			}
+		}
+
+		return first;
+	}
+	friend Matrix<T> operator-(const TriangularMatrix& first, Matrix<T> second) {
+		return first + (-std::move(second));
+	}
+
+	friend Matrix<T> operator*(const TriangularMatrix& first, const Matrix<T>& second) {
+		if (first.n != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.n, second.Width());
+		ParallelFor(0, first.n, RowGrain(first.n * second.Width() / 2), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k = first.First(i); k < first.Last(i); ++k) {
+					Axpy(second.Width(), first.Row(i)[k - first.First(i)], second[k].begin(), result[i].begin());
+				}
+			}
+		});
+
+		return result;
+	}
+	friend Matrix<T> operator*(const Matrix<T>& first, const TriangularMatrix& second) {
+		if (first.Width() != second.n) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.Height(), second.n);
+		ParallelFor(0, first.Height(), RowGrain(second.n * second.n / 2), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k = 0; k < second.n; ++k) {
+					Axpy(second.Last(k) - second.First(k), first[i][k], second.Row(k), result[i].begin() + second.First(k));
+				}
+			}
+		});
+
+		return result;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const TriangularMatrix& m) {
+		return out << m.ToMatrix();
+	}
+
+private:
+	std::vector<T> data;
+	size_t n;
+
+	size_t Offset(size_t i) const {
+		return (Upper ? i * n - i * (i - 1) / 2 : i * (i + 1) / 2);
+	}
+
+	void CheckSize(size_t size, const char* message) const {
+		if (n != size) {
+			throw UnsuitableMatrixSizes(message);
+		}
+	}
+	void CheckSize(const Matrix<T>& m, const char* message) const {
+		if (n != m.Height() || n != m.Width()) {
+			throw UnsuitableMatrixSizes(message);
+		}
+	}
+
+	static size_t RowGrain(size_t rowCost) {
+		return std::max<size_t>(1, (1 << 14) / std::max<size_t>(rowCost, 1));
+	}
+};
+
+template<typename T>
+using UpperTriangularMatrix = TriangularMatrix<T, true>;
+template<typename T>
+using LowerTriangularMatrix = TriangularMatrix<T, false>;
+
+// Elements (i, j) with i - Lower() <= j <= i + Upper(). Every row keeps Lower() + Upper() + 1 slots, the
+// ones that fall outside of the matrix in the first and last rows stay zero.
+template<typename T>
+class BandedMatrix {
+public:
+	BandedMatrix() : n(0), lower(0), upper(0) {}
+	BandedMatrix(size_t n, size_t lower, size_t upper) : data(n * (lower + upper + 1)), n(n), lower(lower), upper(upper) {}
+	// Keeps only the band of A
+	BandedMatrix(const Matrix<T>& A, size_t lower, size_t upper) : BandedMatrix(A.Height(), lower, upper) {
+		if (A.Height() != A.Width()) {
+			throw UnsuitableMatrixSizes("BandedMatrix must take squere matrix");
+		}
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t j = First(i); j < Last(i); ++j) {
+				(*this)(i, j) = A[i][j];
+			}
+		}
+	}
+
+	size_t Size() const {
+		return n;
+	}
+	size_t Height() const {
+		return n;
+	}
+	size_t Width() const {
+		return n;
+	}
+	size_t Lower() const {
+		return lower;
+	}
+	size_t Upper() const {
+		return upper;
+	}
+
+	// Columns of row i inside the band and the matrix
+	size_t First(size_t i) const {
+		return (i > lower ? i - lower : 0);
+	}
+	size_t Last(size_t i) const {
+		return std::min(n, i + upper + 1);
+	}
+
+	T operator()(size_t i, size_t j) const {
+		return (First(i) <= j && j < Last(i) ? data[Index(i, j)] : T{});
+	}
+	T& operator()(size_t i, size_t j) {
+		if (j < First(i) || Last(i) <= j) {
+			throw std::out_of_range("element is outside of the band");
+		}
+		return data[Index(i, j)];
+	}
+
+	Matrix<T> ToMatrix() const {
+		Matrix<T> result(n, n);
+		for (size_t i = 0; i < n; ++i) {
+			std::copy(data.begin() + Index(i, First(i)), data.begin() + Index(i, Last(i) - 1) + 1, result[i].begin() + First(i));
+		}
+
+		return result;
+	}
+
+	T Det() const {
+		static_assert(IsField<T>, "Det needs an element type with division");
+		bool negate = false;
+		std::vector<T> work = Eliminate(nullptr, negate);
+		if (work.empty()) {
+			return T{ 0 };
+		}
+
+		const size_t w = 2 * lower + upper + 1;
+		T result{ 1 };
+		for (size_t i = 0; i < n; ++i) {
+			result *= work[i * w + lower];
+		}
+
+		return (negate ? -result : result);
+	}
+
+	// X with AX = B. Gaussian elimination with partial pivoting stays inside the band widened by Lower()
+	// columns to the right, so the cost is O(n * Lower() * (Lower() + Upper())) per column of B.
+	Matrix<T> Solve(Matrix<T> b) const {
+		static_assert(IsField<T>, "Solve needs an element type with division");
+		if (b.Height() != n) {
+			throw UnsuitableMatrixSizes("Solve must take a right-hand side with the height of the matrix");
+		}
+
+		bool negate = false;
+		const std::vector<T> work = Eliminate(&b, negate);
+		if (work.empty()) {
+			throw std::runtime_error("Degenerate matrix");
+		}
+
+		const size_t w = 2 * lower + upper + 1;
+		for (size_t k = n; k-- > 0;) {
+			const T* row = work.data() + k * w + lower - k;
+			for (size_t j = k + 1; j < std::min(n, k + lower + upper + 1); ++j) {
+				if (!(row[j] == 0)) {
+					Axpy(b.Width(), T{ -row[j] }, b[j].begin(), b[k].begin());
+				}
+			}
+
+			const T d = 1 / row[k];
+			for (T& x : b[k]) {
+				x *= d;
+			}
+		}
+
+		return b;
+	}
+
+	friend BandedMatrix operator*(const BandedMatrix& first, const BandedMatrix& second) {
+		if (first.n != second.n) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices of the same length");
+		}
+
+		BandedMatrix result(first.n, first.lower + second.lower, first.upper + second.upper);
+		for (size_t i = 0; i < first.n; ++i) {
+			for (size_t k = first.First(i); k < first.Last(i); ++k) {
+				const T& a = first.data[first.Index(i, k)];
+				for (size_t j = second.First(k); j < second.Last(k); ++j) {
+					result.data[result.Index(i, j)] += a * second.data[second.Index(k, j)];
+				}
+			}
+		}
+
+		return result;
+	}
+
+	// In pair with Matrix
+public:
+	friend Matrix<T> operator+(Matrix<T> first, const BandedMatrix& second) {
+		second.CheckSize(first, "operator+ must take two matrices of the same length");
+		for (size_t i = 0; i < second.n; ++i) {
+			for (size_t j = second.First(i); j < second.Last(i); ++j) {
+				first[i][j] += second.data[second.Index(i, j)];
+			}
+		}
+
+		return first;
+	}
+	friend Matrix<T> operator+(const BandedMatrix& first, Matrix<T> second) {
+		return std::move(second) + first;
+	}
+	friend Matrix<T> operator-(Matrix<T> first, const BandedMatrix& second) {
+		second.CheckSize(first, "operator- must take two matrices of the same length");
+		for (size_t i = 0; i < second.n; ++i) {
+			for (size_t j = second.First(i); j < second.Last(i); ++j) {
+				first[i][j] -= second.data[second.Index(i, j)];
+			}
+		}
+
+		return first;
+	}
+	friend Matrix<T> operator-(const BandedMatrix& first, Matrix<T> second) {
+		return first + (-std::move(second));
+	}
+
+	friend Matrix<T> operator*(const BandedMatrix& first, const Matrix<T>& second) {
+		if (first.n != second.Height()) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.n, second.Width());
+		ParallelFor(0, first.n, RowGrain((first.lower + first.upper + 1) * second.Width()), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k = first.First(i); k < first.Last(i); ++k) {
+					Axpy(second.Width(), first.data[first.Index(i, k)], second[k].begin(), result[i].begin());
+				}
+			}
+		});
+
+		return result;
+	}
+	friend Matrix<T> operator*(const Matrix<T>& first, const BandedMatrix& second) {
+		if (first.Width() != second.n) {
+			throw UnsuitableMatrixSizes("operator* must take two matrices such that the width of the first matrix is ​​equal to the height of the second");
+		}
+
+		Matrix<T> result(first.Height(), second.n);
+		ParallelFor(0, first.Height(), RowGrain((second.lower + second.upper + 1) * second.n), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				for (size_t k = 0; k < second.n; ++k) {
+					Axpy(second.Last(k) - second.First(k), first[i][k], second.data.data() + second.Index(k, second.First(k)), result[i].begin() + second.First(k));
+				}
+			}
+		});
+
+		return result;
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const BandedMatrix& m) {
+		return out << m.ToMatrix();
+	}
+
+private:
+	std::vector<T> data;
+	size_t n, lower, upper;
+
+	size_t Index(size_t i, size_t j) const {
+		return i * (lower + upper + 1) + (j + lower - i);
+	}
+
+	// Row-reduces a copy of the band, widened by lower columns for the fill-in of row swaps, and applies
+	// the same steps to b. Element (i, j) of the result is at i * (2 * lower + upper + 1) + j + lower - i.
+	// Empty when the matrix is singular.
+	std::vector<T> Eliminate(Matrix<T>* b, bool& negate) const {
+		const size_t w = 2 * lower + upper + 1;
+		std::vector<T> work(n * w);
+		for (size_t i = 0; i < n; ++i) {
+			std::copy(data.begin() + Index(i, First(i)), data.begin() + Index(i, Last(i) - 1) + 1, work.begin() + i * w + (First(i) + lower - i));
+		}
+		auto at = [&](size_t i, size_t j) -> T& {
+			return work[i * w + j + lower - i];
+		};
+
+		for (size_t k = 0; k < n; ++k) {
+			const size_t end = std::min(n, k + lower + 1), right = std::min(n, k + lower + upper + 1);
+			size_t pivot = k;
+			for (size_t i = k; i < end; ++i) {
+				if constexpr (std::is_floating_point<T>::value) {
+					if (std::abs(at(i, k)) > std::abs(at(pivot, k)))
+						pivot = i;
+				}
+				else if (at(i, k) != 0) {
+					pivot = i;
+					break;
+				}
+			}
+
+			if (at(pivot, k) == 0) {
+				return {};
+			}
+			if (pivot != k) {
+				for (size_t j = k; j < right; ++j) {
+					std::swap(at(pivot, j), at(k, j));
+				}
+				if (b) {
+					b->SwapRows(pivot, k);
+				}
+				negate = !negate;
+			}
+
+			const T d = 1 / at(k, k);
+			for (size_t i = k + 1; i < end; ++i) {
+				if (at(i, k) == 0) {
+					continue;
+				}
+
+				const T f = at(i, k) * d;
+				at(i, k) = T{ 0 };
+				Axpy(right - k - 1, T{ -f }, &at(k, k + 1), &at(i, k + 1));
+				if (b) {
+					Axpy(b->Width(), T{ -f }, (*b)[k].begin(), (*b)[i].begin());
+				}
+			}
+		}
+
+		return work;
+	}
+
+	void CheckSize(const Matrix<T>& m, const char* message) const {
+		if (n != m.Height() || n != m.Width()) {
+			throw UnsuitableMatrixSizes(message);
+		}
+	}
+
+	static size_t RowGrain(size_t rowCost) {
+		return std::max<size_t>(1, (1 << 14) / std::max<size_t>(rowCost, 1));
+	}
+};
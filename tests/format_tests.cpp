@@ -0,0 +1,177 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/format_tests.cpp *.cpp -pthread
+
+#include "binary_format.h"
+#include "linal.h"
+#include "matrix.h"
+#include "mod_int.h"
+#include "rational.h"
+#include "text_format.h"
+
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::mt19937_64 generator(1);
+
+template<typename T>
+static Matrix<T> RandomMatrix(size_t height, size_t width) {
+	Matrix<T> result(height, width);
+	for (T& x : result.GetData())
+		x = T(static_cast<long long>(generator() % 2001) - 1000);
+	return result;
+}
+
+template<typename X, typename Read>
+static void AssertBinaryRoundTrip(const X& x, Read read) {
+	std::stringstream stream;
+	WriteBinary(stream, x);
+	assert(read(stream) == x);
+}
+
+// Every kind and element type comes back unchanged, BigInteger parts of Rational included
+static void TestBinaryRoundTrip() {
+	Matrix<double> doubles = RandomMatrix<double>(13, 7);
+	doubles[0][0] = 1.0 / 3;
+	AssertBinaryRoundTrip(doubles, [](std::istream& in) { return ReadBinaryMatrix<double>(in); });
+	AssertBinaryRoundTrip(RandomMatrix<int>(4, 9), [](std::istream& in) { return ReadBinaryMatrix<int>(in); });
+	AssertBinaryRoundTrip(RandomMatrix<ModInt<998244353>>(5, 5), [](std::istream& in) { return ReadBinaryMatrix<ModInt<998244353>>(in); });
+
+	Matrix<Rational> rationals = RandomMatrix<Rational>(6, 3);
+	rationals[1][2] = Rational(LLONG_MAX) * 5 / 7;
+	rationals[2][0] = Rational(-3, 11);
+	AssertBinaryRoundTrip(rationals, [](std::istream& in) { return ReadBinaryMatrix<Rational>(in); });
+	AssertBinaryRoundTrip(Matrix<Rational>(), [](std::istream& in) { return ReadBinaryMatrix<Rational>(in); });
+
+	AssertBinaryRoundTrip(Poly<long long>(std::vector<long long>{ 3, 0, -2, 7 }), [](std::istream& in) { return ReadBinaryPoly<long long>(in); });
+	AssertBinaryRoundTrip(Rational(LLONG_MIN) - 1, [](std::istream& in) { return ReadBinaryRational(in); });
+
+	Basis<Rational> basis{ RandomMatrix<Rational>(3, 1), RandomMatrix<Rational>(3, 1) };
+	AssertBinaryRoundTrip(basis, [](std::istream& in) { return ReadBinaryBasis<Rational>(in); });
+}
+
+// A saved matrix mapped back reads the same elements and multiplies like the original
+static void TestMatrixView() {
+	const std::string path = "format_tests_view.bin";
+	const Matrix<double> a = RandomMatrix<double>(33, 20), b = RandomMatrix<double>(20, 5);
+	SaveBinary(path, a);
+	{
+		const MatrixView<double> view(path);
+		assert(view.Height() == a.Height() && view.Width() == a.Width());
+		for (size_t i = 0; i < a.Height(); ++i)
+			for (size_t j = 0; j < a.Width(); ++j)
+				assert(view[i][j] == a[i][j]);
+		assert(view.ToMatrix() == a);
+		assert(view * b == a * b);
+		assert(LoadBinaryMatrix<double>(path) == a);
+	}
+	std::remove(path.c_str());
+}
+
+template<typename T>
+static Matrix<T> TextRoundTrip(const Matrix<T>& m, int precision) {
+	std::stringstream stream;
+	stream.precision(precision);
+	WriteMatrixText(stream, m);
+	Matrix<T> result;
+	stream >> result;
+	return result;
+}
+
+// WriteMatrixText output is read back by operator>>, exactly for integers and fractions and for doubles
+// printed with 17 significant digits
+static void TestTextRoundTrip() {
+	const Matrix<long long> integers = RandomMatrix<long long>(17, 11);
+	assert(TextRoundTrip(integers, 6) == integers);
+
+	Matrix<Rational> rationals = RandomMatrix<Rational>(5, 4);
+	rationals[0][0] = Rational(-7, 3);
+	rationals[4][3] = Rational(LLONG_MAX) * LLONG_MAX / 11;
+	assert(TextRoundTrip(rationals, 6) == rationals);
+
+	Matrix<double> doubles = RandomMatrix<double>(8, 8);
+	doubles[3][5] = 1.0 / 3;
+	doubles[7][0] = -2.5e-300;
+	assert(TextRoundTrip(doubles, 17) == doubles);
+
+	// The table printer aligns columns on the widest element
+	Matrix<long long> small(2, 2);
+	small[0][0] = -15;
+	small[1][1] = 3;
+	std::ostringstream table;
+	table << small;
+	assert(table.str() == "|-15 0|\n|  0 3|");
+}
+
+// Elements follow the floatfield and precision of the stream exactly as operator<< on each of them would
+static void TestFloatFormatFlags() {
+	Matrix<double> m(1, 5);
+	m[0][0] = 1.0 / 3;
+	m[0][1] = -2.5e10;
+	m[0][2] = 1e300;
+	m[0][3] = -0.0;
+	m[0][4] = 3;
+	for (std::ios_base::fmtflags field : { std::ios_base::fmtflags{}, std::ios_base::fixed, std::ios_base::scientific, std::ios_base::fixed | std::ios_base::scientific }) {
+		for (int precision : { 0, 3, 17 }) {
+			std::ostringstream table, expected;
+			for (std::ostream* out : { static_cast<std::ostream*>(&table), static_cast<std::ostream*>(&expected) }) {
+				out->setf(field, std::ios_base::floatfield);
+				out->precision(precision);
+			}
+			table << m;
+			expected << '|';
+			for (size_t j = 0; j < m.Width(); ++j)
+				expected << (j ? " " : "") << m[0][j];
+			expected << '|';
+			assert(table.str() == expected.str());
+		}
+	}
+
+	std::ostringstream poly;
+	poly << std::fixed << std::setprecision(2) << Poly<double>(std::vector<double>{ 0.5, 0, 1.25 });
+	assert(poly.str() == "1.25t^2+0.50");
+}
+
+// Malformed input sets failbit like any operator>>, TextParseError only comes when the exception mask asks for it
+static void TestParseErrorState() {
+	Matrix<long long> m(1, 1, 42);
+	std::istringstream bad("2 2\n1 2\n3 x\n");
+	assert(!(bad >> m));
+	assert(bad.fail());
+	assert(m == Matrix<long long>(1, 1, 42));
+
+	std::istringstream throwing("2 2\n1 2\n3 x\n");
+	throwing.exceptions(std::ios_base::failbit);
+	bool thrown = false;
+	try {
+		throwing >> m;
+	}
+	catch (const TextParseError& error) {
+		thrown = true;
+		assert(error.Line() == 3 && error.Column() == 3);
+	}
+	assert(thrown);
+	assert(throwing.fail());
+
+	std::istringstream good("2 2 1 2 3 4 5");
+	int rest = 0;
+	assert(good >> m >> rest);
+	assert(m[1][1] == 4 && rest == 5);
+}
+
+int main() {
+	TestBinaryRoundTrip();
+	TestMatrixView();
+	TestTextRoundTrip();
+	TestFloatFormatFlags();
+	TestParseErrorState();
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,121 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/linal_tests.cpp *.cpp -pthread
+
+#include "linal.h"
+#include "matrix.h"
+#include "rational.h"
+#include "sparse_matrix.h"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+static std::mt19937_64 generator(1);
+
+// About density * height * width entries in [-9, 9], plus rows that repeat earlier ones so the rank drops
+template<typename T>
+static SparseMatrix<T> RandomSparse(size_t height, size_t width, double density) {
+	std::vector<std::tuple<size_t, size_t, T>> entries;
+	std::uniform_real_distribution<double> uniform(0, 1);
+	for (size_t i = 0; i < height; ++i)
+		for (size_t j = 0; j < width; ++j)
+			if (uniform(generator) < density)
+				entries.emplace_back(i, j, T(static_cast<long long>(generator() % 19) - 9));
+	Matrix<T> dense = SparseMatrix<T>(height, width, entries).ToDense();
+	for (size_t i = 0; i + 1 < height; i += 5)
+		for (size_t j = 0; j < width; ++j)
+			dense[i + 1][j] = 2 * dense[i][j];
+	return SparseMatrix<T>(dense);
+}
+
+// Sparse and dense products agree, the CSC form is the CSR form of the transpose
+static void TestSparseProducts() {
+	const SparseMatrix<long long> a = RandomSparse<long long>(40, 30, 0.1), b = RandomSparse<long long>(30, 25, 0.1);
+	const Matrix<long long> da = a.ToDense(), db = b.ToDense();
+	assert(a * db == da * db);
+	assert(da * b == da * db);
+	assert((a * b).ToDense() == da * db);
+
+	Matrix<long long> transposed = da;
+	transposed.Transpose();
+	assert(a.Transposed().ToDense() == transposed);
+	assert(a.Transposed().Transposed().ToDense() == da);
+}
+
+// Echelon form of the sparse elimination has the dense rank, every kernel vector is annihilated
+template<typename T>
+static void TestSparseKernel(const SparseMatrix<T>& a, size_t expectedRank) {
+	const Matrix<T> dense = a.ToDense();
+	const size_t rank = a.Rank();
+	assert(rank == expectedRank);
+
+	const Basis<T> kernel = KerBasis(a);
+	assert(kernel.size() == a.Width() - rank);
+	for (const auto& v : kernel) {
+		const Matrix<T> product = dense * v;
+		for (const T& x : product.GetData()) {
+			if constexpr (std::is_floating_point<T>::value)
+				assert(std::abs(x) < 1e-9);
+			else
+				assert(x == 0);
+		}
+	}
+	assert(ImBasis(a).size() == rank);
+}
+
+// Arrowhead matrix: pivoting on the dense corner first would fill everything, Markowitz leaves it for last
+static void TestMarkowitzFill() {
+	const size_t n = 200;
+	std::vector<std::tuple<size_t, size_t, double>> entries;
+	for (size_t i = 0; i < n; ++i) {
+		entries.emplace_back(i, i, 4.0);
+		if (i != 0) {
+			entries.emplace_back(0, i, 1.0);
+			entries.emplace_back(i, 0, 1.0);
+		}
+	}
+	const SparseEchelonForm<double> echelon = SparseMatrix<double>(n, n, entries).Echelon();
+	assert(echelon.pivotColumns.size() == n);
+	size_t stored = 0;
+	for (const auto& row : echelon.pivotRows)
+		stored += row.size();
+	assert(stored <= 3 * n);
+}
+
+// Combinations with coefficients that are not exact in binary leave rounding noise where the exact result is 0,
+// which must be dropped instead of becoming pivots
+static void TestDropTolerance() {
+	const size_t height = 40, width = 30;
+	Matrix<long long> base(20, width);
+	for (auto& x : base.GetData())
+		if (generator() % 4 == 0)
+			x = static_cast<long long>(generator() % 1000);
+
+	Matrix<double> dense(height, width);
+	for (size_t i = 0; i < height; ++i)
+		for (size_t j = 0; j < width; ++j)
+			dense[i][j] = (i < 20 ? base[i][j] : 0.1 * base[i - 20][j] + 0.7 * base[(i * 7) % 20][j]);
+
+	assert(SparseMatrix<double>(dense).Rank() == Rank(Matrix<Rational>(base)));
+}
+
+int main() {
+	TestSparseProducts();
+	TestMarkowitzFill();
+	TestDropTolerance();
+	// Sizes and densities where the fraction-free integer elimination stays within long long
+	for (auto [height, width, density] : { std::tuple<size_t, size_t, double>{ 30, 40, 0.1 }, { 60, 50, 0.05 }, { 12, 15, 0.3 } }) {
+		const SparseMatrix<long long> a = RandomSparse<long long>(height, width, density);
+		const size_t rank = Rank(Matrix<Rational>(a.ToDense()));
+		TestSparseKernel(a, rank);
+		TestSparseKernel(SparseMatrix<Rational>(Matrix<Rational>(a.ToDense())), rank);
+		TestSparseKernel(SparseMatrix<double>(Matrix<double>(a.ToDense())), rank);
+	}
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
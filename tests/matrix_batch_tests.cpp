@@ -0,0 +1,92 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/matrix_batch_tests.cpp *.cpp -pthread
+
+#include "matrix.h"
+#include "matrix_batch.h"
+#include "rational.h"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+static std::mt19937_64 generator(1);
+
+// Integers go through Bareiss, every item must match the determinant of the matrix on its own
+static void TestIntegerDet() {
+	for (size_t n : { 1, 2, 5, 9 }) {
+		MatrixBatch<long long> batch(37, n, n);
+		for (size_t item = 0; item < batch.Count(); ++item) {
+			Matrix<long long> m(n, n);
+			for (size_t i = 0; i < n; ++i)
+				for (size_t j = 0; j < n; ++j)
+					m[i][j] = static_cast<long long>(generator() % 7) - 3;
+			// Every third item singular
+			if (item % 3 == 0 && n > 1)
+				for (size_t j = 0; j < n; ++j)
+					m[n - 1][j] = 2 * m[0][j];
+			batch.Set(item, m);
+		}
+
+		const std::vector<long long> det = batch.Det();
+		for (size_t item = 0; item < batch.Count(); ++item) {
+			assert(det[item] == batch.Get(item).Det());
+			if (item % 3 == 0 && n > 1)
+				assert(det[item] == 0);
+		}
+	}
+}
+
+static void TestInverseMatchesMatrix() {
+	const size_t n = 4;
+	MatrixBatch<Rational> batch(10, n, n);
+	for (size_t item = 0; item < batch.Count(); ++item) {
+		Matrix<Rational> m(n, n);
+		for (size_t i = 0; i < n; ++i)
+			for (size_t j = 0; j < n; ++j)
+				m[i][j] = Rational(static_cast<long long>(generator() % 9) - 4);
+		if (item == 3)
+			for (size_t j = 0; j < n; ++j)
+				m[2][j] = m[1][j];
+		batch.Set(item, m);
+	}
+
+	MatrixBatch<Rational> inverse = batch;
+	const std::vector<char> singular = inverse.Inverse();
+	for (size_t item = 0; item < batch.Count(); ++item) {
+		const Matrix<Rational> m = batch.Get(item);
+		assert(static_cast<bool>(singular[item]) == (m.Det() == 0));
+		if (!singular[item]) {
+			Matrix<Rational> expected = m;
+			expected.Inverse();
+			assert(inverse.Get(item) == expected);
+		}
+	}
+
+	MatrixBatch<double> doubles(20, n, n);
+	for (size_t item = 0; item < doubles.Count(); ++item)
+		for (size_t i = 0; i < n; ++i)
+			for (size_t j = 0; j < n; ++j)
+				doubles(item, i, j) = static_cast<double>(generator() % 2001) / 1000 - 1 + (i == j ? 3 : 0);
+	MatrixBatch<double> rhs(doubles.Count(), n, 2);
+	for (size_t item = 0; item < rhs.Count(); ++item)
+		for (size_t i = 0; i < n; ++i)
+			for (size_t j = 0; j < 2; ++j)
+				rhs(item, i, j) = static_cast<double>(i + j);
+	MatrixBatch<double> x = rhs;
+	assert(doubles.Solve(x) == std::vector<char>(doubles.Count(), 0));
+	for (size_t item = 0; item < doubles.Count(); ++item) {
+		const Matrix<double> residual = doubles.Get(item) * x.Get(item) - rhs.Get(item);
+		for (size_t i = 0; i < n; ++i)
+			for (size_t j = 0; j < 2; ++j)
+				assert(std::abs(residual[i][j]) < 1e-9);
+	}
+}
+
+int main() {
+	TestIntegerDet();
+	TestInverseMatchesMatrix();
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
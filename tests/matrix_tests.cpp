@@ -0,0 +1,332 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/matrix_tests.cpp *.cpp -pthread
+
+#include "fixed_matrix.h"
+#include "linal.h"
+#include "lu_decomposition.h"
+#include "matrix.h"
+#include "mod_int.h"
+#include "rational.h"
+#include "structured_matrix.h"
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static std::mt19937_64 generator(1);
+
+// Entries in [-range, range]
+template<typename T>
+static Matrix<T> RandomMatrix(size_t height, size_t width, long long range) {
+	Matrix<T> result(height, width);
+	for (T& x : result.GetData())
+		x = T(static_cast<long long>(generator() % (2 * range + 1)) - range);
+	return result;
+}
+
+template<typename T>
+static Matrix<T> NaiveProduct(const Matrix<T>& a, const Matrix<T>& b) {
+	Matrix<T> c(a.Height(), b.Width());
+	for (size_t i = 0; i < a.Height(); ++i)
+		for (size_t j = 0; j < b.Width(); ++j)
+			for (size_t p = 0; p < a.Width(); ++p)
+				c[i][j] += a[i][p] * b[p][j];
+	return c;
+}
+
+static bool Close(const Matrix<double>& a, const Matrix<double>& b, double tolerance) {
+	if (a.Height() != b.Height() || a.Width() != b.Width())
+		return false;
+	for (size_t k = 0; k < a.GetData().size(); ++k)
+		if (std::abs(a.GetData()[k] - b.GetData()[k]) > tolerance * (1 + std::abs(b.GetData()[k])))
+			return false;
+	return true;
+}
+
+// One row-major buffer, rows are views into it
+static void TestContiguousStorage() {
+	const Matrix<long long> a = RandomMatrix<long long>(5, 7, 100);
+	assert(a.GetData().size() == 35);
+	for (size_t i = 0; i < a.Height(); ++i)
+		for (size_t j = 0; j < a.Width(); ++j)
+			assert(&a[i][j] == a.GetData().data() + i * a.Width() + j);
+
+	Matrix<long long> t = a;
+	t.Transpose();
+	assert(t.Height() == 7 && t.Width() == 5);
+	for (size_t i = 0; i < a.Height(); ++i)
+		for (size_t j = 0; j < a.Width(); ++j)
+			assert(t[j][i] == a[i][j]);
+}
+
+// Sizes around the cache blocks and the micro-kernel tile, so every edge case of the packing runs
+static void TestGemmMatchesNaive() {
+	for (auto [m, k, n] : { std::tuple<size_t, size_t, size_t>{ 1, 1, 1 }, { 3, 5, 7 }, { 97, 300, 45 }, { 130, 257, 70 } }) {
+		const Matrix<long long> a = RandomMatrix<long long>(m, k, 1000), b = RandomMatrix<long long>(k, n, 1000);
+		assert(a * b == NaiveProduct(a, b));
+
+		const Matrix<double> c = RandomMatrix<double>(m, k, 1000), d = RandomMatrix<double>(k, n, 1000);
+		assert(Close(c * d, NaiveProduct(c, d), 1e-12));
+	}
+}
+
+// A low crossover makes small products recurse several levels, odd sizes included
+static void TestStrassenMatchesClassic() {
+	const size_t saved = StrassenCrossover<double>();
+	StrassenCrossover<double>() = 8;
+	for (size_t n : { 64, 101 }) {
+		const Matrix<double> a = RandomMatrix<double>(n, n + 3, 100), b = RandomMatrix<double>(n + 3, n - 1, 100);
+		assert(Close(a * b, NaiveProduct(a, b), 1e-10));
+	}
+	StrassenCrossover<double>() = saved;
+
+	using M = ModInt<998244353>;
+	const size_t savedModInt = StrassenCrossover<M>();
+	StrassenCrossover<M>() = 8;
+	const Matrix<M> a = RandomMatrix<M>(90, 90, 1000000), b = RandomMatrix<M>(90, 90, 1000000);
+	assert(a * b == NaiveProduct(a, b));
+	StrassenCrossover<M>() = savedModInt;
+
+	// Off by default where the pre-additions could overflow or grow fractions, integers can opt in
+	assert(StrassenCrossover<long long>() == SIZE_MAX && StrassenCrossover<int>() == SIZE_MAX);
+	assert(StrassenCrossover<Rational>() == SIZE_MAX);
+	StrassenCrossover<long long>() = 8;
+	const Matrix<long long> c = RandomMatrix<long long>(70, 45, 1000), d = RandomMatrix<long long>(45, 33, 1000);
+	assert(c * d == NaiveProduct(c, d));
+	StrassenCrossover<long long>() = SIZE_MAX;
+}
+
+// Same results on one thread and on several, ParallelFor covers the range exactly once
+static void TestThreadPool() {
+	const Matrix<long long> a = RandomMatrix<long long>(200, 150, 100), b = RandomMatrix<long long>(150, 180, 100);
+	ThreadPool::SetGlobalThreadCount(1);
+	const Matrix<long long> single = a * b;
+	ThreadPool::SetGlobalThreadCount(4);
+	assert(a * b == single);
+
+	std::vector<std::atomic<int>> hits(10007);
+	ParallelFor(0, hits.size(), 13, [&](size_t lo, size_t hi) {
+		ParallelFor(lo, hi, 4, [&](size_t lo2, size_t hi2) {
+			for (size_t i = lo2; i < hi2; ++i)
+				++hits[i];
+		});
+	});
+	for (const auto& x : hits)
+		assert(x == 1);
+	ThreadPool::SetGlobalThreadCount(0);
+}
+
+// Bareiss for integers, Gauss for fields, det(AB) = det(A) det(B)
+static void TestDet() {
+	for (size_t n : { 1, 2, 5, 8 }) {
+		const Matrix<long long> a = RandomMatrix<long long>(n, n, 3), b = RandomMatrix<long long>(n, n, 3);
+		assert((a * b).Det() == a.Det() * b.Det());
+		assert(Matrix<Rational>(a).Det() == a.Det());
+		assert(std::abs(Matrix<double>(a).Det() - a.Det()) < 1e-6 * (1 + std::abs(a.Det())));
+	}
+
+	Matrix<long long> singular = RandomMatrix<long long>(6, 6, 5);
+	for (size_t j = 0; j < 6; ++j)
+		singular[4][j] = singular[1][j] - 3 * singular[2][j];
+	assert(singular.Det() == 0);
+}
+
+// Both characteristic polynomials agree, p(0) = (-1)^n det A and p(A) = 0
+static void TestCharacteristicPoly() {
+	for (size_t n : { 1, 3, 6 }) {
+		const Matrix<Rational> a = RandomMatrix<Rational>(n, n, 5);
+		const Poly<Rational> p = a.CharacteristicPoly();
+		assert(p == a.CharacteristicPolyInterpolated());
+		assert(p.Degree() == static_cast<int>(n));
+		assert(p[0] == (n % 2 ? -a.Det() : a.Det()));
+
+		Matrix<Rational> value(n, n);
+		for (int i = p.Degree(); i >= 0; --i)
+			value = value * a + p[i] * Matrix<Rational>::E(n, n);
+		assert(value == Matrix<Rational>(n, n));
+	}
+}
+
+// Fused elementwise expressions and the compound operators that work in place
+static void TestElementwiseArithmetic() {
+	const Matrix<long long> a = RandomMatrix<long long>(9, 11, 50), b = RandomMatrix<long long>(9, 11, 50), c = RandomMatrix<long long>(9, 11, 50);
+	const Matrix<long long> fused = a + b - 2 * c + -a * 3;
+	for (size_t i = 0; i < a.Height(); ++i)
+		for (size_t j = 0; j < a.Width(); ++j)
+			assert(fused[i][j] == a[i][j] + b[i][j] - 2 * c[i][j] - 3 * a[i][j]);
+
+	Matrix<long long> d = a;
+	const long long* buffer = d.GetData().data();
+	d += b;
+	d -= c;
+	d *= 4;
+	assert(d.GetData().data() == buffer);
+	assert(d == 4 * (a + b - c));
+
+	// An rvalue operand lends its buffer to the result
+	Matrix<long long> e = a;
+	buffer = e.GetData().data();
+	const Matrix<long long> f = std::move(e) + b;
+	assert(f.GetData().data() == buffer);
+	assert(f == a + b);
+}
+
+static void TestFixedMatrix() {
+	static_assert(FixedMatrix<long long, 2, 2>{ { 1, 2 }, { 3, 4 } }.Det() == -2, "FixedMatrix::Det must be usable in constant expressions");
+
+	FixedMatrix<Rational, 3, 3> a;
+	const Matrix<Rational> dense = RandomMatrix<Rational>(3, 3, 5) + Matrix<Rational>::E(3, 3) * 20;
+	a = FixedMatrix<Rational, 3, 3>(dense);
+	assert(a.Det() == dense.Det());
+
+	FixedMatrix<Rational, 3, 3> inverse = a;
+	inverse.Inverse();
+	Matrix<Rational> denseInverse = dense;
+	denseInverse.Inverse();
+	assert(Matrix<Rational>(inverse) == denseInverse);
+	assert(a * inverse == (FixedMatrix<Rational, 3, 3>::E()));
+	assert(Matrix<Rational>(a ^ 5) == (dense ^ 5));
+}
+
+// Every available instruction set gives the same results as the scalar loop
+static void TestSimdLevels() {
+	const SimdLevel detected = DetectedSimdLevel();
+	std::vector<double> x(1003), y(1003);
+	std::vector<long long> u(1003), v(1003);
+	for (size_t i = 0; i < x.size(); ++i) {
+		x[i] = static_cast<double>(generator() % 1000) / 8;
+		y[i] = static_cast<double>(generator() % 1000) / 4;
+		u[i] = static_cast<long long>(generator() % 1000000);
+		v[i] = static_cast<long long>(generator() % 1000000);
+	}
+
+	for (int level = 0; level <= static_cast<int>(detected); ++level) {
+		SetSimdLevel(static_cast<SimdLevel>(level));
+		std::vector<double> y2 = y;
+		std::vector<long long> v2 = v;
+		Axpy(x.size(), 3.0, x.data(), y2.data());
+		Axpy(u.size(), 7LL, u.data(), v2.data());
+		for (size_t i = 0; i < x.size(); ++i) {
+			assert(y2[i] == y[i] + 3.0 * x[i]);
+			assert(v2[i] == v[i] + 7 * u[i]);
+		}
+
+		const Matrix<double> a = RandomMatrix<double>(37, 41, 100), b = RandomMatrix<double>(41, 29, 100);
+		assert(Close(a * b, NaiveProduct(a, b), 1e-12));
+	}
+	SetSimdLevel(detected);
+}
+
+// Huge exponents through x^k mod the characteristic polynomial agree with repeated squaring
+static void TestCayleyHamiltonPowers() {
+	using M = ModInt<998244353>;
+	const Matrix<M> a = RandomMatrix<M>(7, 7, 1000);
+	const Matrix<M> v = RandomMatrix<M>(7, 2, 1000);
+	for (long long k : { 0LL, 1LL, 6LL, 7LL, 123456789012345LL }) {
+		const Matrix<M> power = a ^ k;
+		assert(a.PowerCayleyHamilton(k) == power);
+		assert(a.PowerTimes(k, v) == power * v);
+	}
+}
+
+static void TestLUDecomposition() {
+	const Matrix<Rational> a = RandomMatrix<Rational>(6, 6, 9), b = RandomMatrix<Rational>(6, 4, 9);
+	const LUDecomposition<Rational> lu(a);
+	assert(!lu.IsSingular());
+	assert(lu.Det() == a.Det());
+	assert(a * lu.Solve(b) == b);
+
+	Matrix<Rational> inverse = a;
+	inverse.Inverse();
+	assert(lu.Inverse() == inverse);
+
+	Matrix<Rational> singular = a;
+	for (size_t j = 0; j < 6; ++j)
+		singular[5][j] = singular[0][j] + singular[3][j];
+	assert(LUDecomposition<Rational>(singular).IsSingular());
+	assert(LUDecomposition<Rational>(singular).Det() == 0);
+}
+
+// Integer elimination stays integral: the kernel is exact and the Hermite form is reduced
+static void TestFractionFreeForms() {
+	Matrix<long long> a = RandomMatrix<long long>(5, 8, 9);
+	for (size_t j = 0; j < 8; ++j)
+		a[4][j] = 2 * a[0][j] - a[1][j];
+	assert(Rank(a) == 4);
+	assert(Rank(Matrix<Rational>(a)) == 4);
+
+	const Basis<long long> kernel = KerBasis(a);
+	assert(kernel.size() == 4);
+	for (const auto& v : kernel)
+		assert(a * v == Matrix<long long>(5, 1));
+
+	Matrix<long long> hermite = a;
+	hermite.ToHermiteForm();
+	for (size_t i = 0, j = 0; i < hermite.Height() && j < hermite.Width(); ++j) {
+		if (hermite[i][j] == 0)
+			continue;
+		assert(hermite[i][j] > 0);
+		for (size_t i1 = 0; i1 < i; ++i1)
+			assert(0 <= hermite[i1][j] && hermite[i1][j] < hermite[i][j]);
+		++i;
+	}
+}
+
+// The special kinds agree with the dense matrix they stand for
+static void TestStructuredMatrices() {
+	const Matrix<Rational> dense = RandomMatrix<Rational>(7, 7, 9) + Matrix<Rational>::E(7, 7) * 50, b = RandomMatrix<Rational>(7, 3, 9);
+
+	const DiagonalMatrix<Rational> diagonal(dense);
+	assert(diagonal.Det() == diagonal.ToMatrix().Det());
+	assert(diagonal.ToMatrix() * diagonal.Solve(b) == b);
+
+	const UpperTriangularMatrix<Rational> upper(dense);
+	assert(upper.Det() == upper.ToMatrix().Det());
+	assert(upper.ToMatrix() * upper.Solve(b) == b);
+	assert(upper.ToMatrix() * upper.Inverse().ToMatrix() == Matrix<Rational>::E(7, 7));
+
+	const LowerTriangularMatrix<Rational> lower(dense);
+	assert(lower.ToMatrix() * lower.Solve(b) == b);
+
+	const BandedMatrix<Rational> banded(dense, 2, 1);
+	assert(banded.Det() == banded.ToMatrix().Det());
+	assert(banded.ToMatrix() * banded.Solve(b) == b);
+}
+
+// Generators compose without type erasure and multiply like the matrices they describe
+static void TestDynamicMatrix() {
+	const auto hilbert = MakeDynamicMatrix<Rational>([](size_t i, size_t j) { return Rational(1, static_cast<long long>(i + j + 1)); });
+	const auto shifted = hilbert * Rational(2) - DynamicMatrix<Rational>(Rational(1));
+	const Matrix<Rational> fixed = shifted.FixSizes(5, 6);
+	for (size_t i = 0; i < 5; ++i)
+		for (size_t j = 0; j < 6; ++j)
+			assert(fixed[i][j] == Rational(2, static_cast<long long>(i + j + 1)) - (i == j ? 1 : 0));
+
+	const Matrix<Rational> a = RandomMatrix<Rational>(4, 5, 9);
+	assert(a * shifted == a * shifted.FixSizes(5, 5));
+	assert(shifted * a == shifted.FixSizes(4, 4) * a);
+}
+
+int main() {
+	TestContiguousStorage();
+	TestGemmMatchesNaive();
+	TestStrassenMatchesClassic();
+	TestThreadPool();
+	TestDet();
+	TestCharacteristicPoly();
+	TestElementwiseArithmetic();
+	TestFixedMatrix();
+	TestSimdLevels();
+	TestCayleyHamiltonPowers();
+	TestLUDecomposition();
+	TestFractionFreeForms();
+	TestStructuredMatrices();
+	TestDynamicMatrix();
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
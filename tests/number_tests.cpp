@@ -0,0 +1,90 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/number_tests.cpp *.cpp -pthread
+
+#include "mod_int.h"
+#include "rational.h"
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+static std::mt19937_64 generator(1);
+
+// Montgomery arithmetic agrees with plain 128-bit arithmetic, also for a modulus close to 2^63
+template<uint64_t P>
+static void TestModIntMatchesWideArithmetic() {
+	using M = ModInt<P>;
+	for (int iteration = 0; iteration < 10000; ++iteration) {
+		const uint64_t x = generator() % P, y = generator() % P;
+		const M a(x), b(y);
+		assert((a + b).Value() == (x + y) % P);
+		assert((a - b).Value() == (x + P - y) % P);
+		assert((a * b).Value() == static_cast<uint64_t>(static_cast<unsigned __int128>(x) * y % P));
+		if (y != 0) {
+			assert((a / b) * b == a);
+			assert(b.Inverse() * b == M(1));
+		}
+	}
+
+	// Fermat: a^(P - 1) = 1, negative powers go through the inverse
+	const M a(static_cast<unsigned long long>(generator() % (P - 1) + 1));
+	assert(a.Pow(static_cast<long long>(P - 1)) == M(1));
+	assert(a.Pow(-3) * a.Pow(3) == M(1));
+	assert(M(-1).Value() == P - 1);
+	assert(M(LLONG_MIN) == -M(static_cast<unsigned long long>(LLONG_MIN)));
+}
+
+// P = 0 reads the modulus chosen at runtime
+static void TestRuntimeModulus() {
+	ModInt<0>::SetModulus(1000003);
+	const ModInt<0> a(123456), b(654321);
+	assert((a * b).Value() == 123456ULL * 654321 % 1000003);
+	assert((a / b) * b == a);
+}
+
+// Inline values promote to BigInteger exactly where long long would overflow and come back when they fit
+static void TestRationalOverflow() {
+	const Rational big = Rational(LLONG_MAX) + 1;
+	std::ostringstream text;
+	text << big << ' ' << big * big << ' ' << Rational(LLONG_MAX, 2LL) * 2 << ' ' << big - 1;
+	assert(text.str() == "9223372036854775808 85070591730234615865843651857942052864 9223372036854775807 9223372036854775807");
+	assert(big - 1 == Rational(LLONG_MAX));
+	assert(big / big == 1);
+
+	// Products of denominators beyond 64 bits
+	const Rational x(1, 3037000499LL), y(1, 3037000493LL);
+	assert((x + y) - y == x);
+	assert(x * y * 3037000499LL * 3037000493LL == 1);
+}
+
+// Reduction to lowest terms, positive denominators and comparisons by 128-bit cross products
+static void TestRationalNormalization() {
+	assert(Rational(6, 4) == Rational(3, 2));
+	assert(Rational(3, -6) == Rational(-1, 2));
+	assert(Rational(6, 4).Numerator() == 3 && Rational(6, 4).Denominator() == 2);
+	assert(Rational(-4, 6).Denominator() == 3);
+
+	const Rational a(LLONG_MAX - 1, LLONG_MAX), b(LLONG_MAX - 2, LLONG_MAX - 1);
+	assert(b < a && a > b && a != b);
+	assert(Rational(-1, LLONG_MAX) < Rational(0) && Rational(0) < Rational(1, LLONG_MAX));
+
+	Rational sum;
+	for (long long k = 1; k <= 40; ++k)
+		sum += Rational(1, k * (k + 1));
+	assert(sum == Rational(40, 41));
+}
+
+int main() {
+	TestModIntMatchesWideArithmetic<998244353>();
+	TestModIntMatchesWideArithmetic<(1ULL << 61) - 1>();
+	TestModIntMatchesWideArithmetic<9223372036854775783ULL>();
+	TestRuntimeModulus();
+	TestRationalOverflow();
+	TestRationalNormalization();
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,134 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/poly_tests.cpp *.cpp -pthread
+
+#include "mod_int.h"
+#include "poly.h"
+#include "rational.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static std::mt19937_64 generator(1);
+
+template<typename T>
+static std::vector<T> Schoolbook(const std::vector<T>& a, const std::vector<T>& b) {
+	std::vector<T> c(a.size() + b.size() - 1, T{ 0 });
+	PolyMultiplySchoolbook(a.data(), a.size(), b.data(), b.size(), c.data());
+	return c;
+}
+
+template<typename T>
+static std::vector<T> RandomModInts(size_t n) {
+	std::vector<T> result(n);
+	for (T& x : result)
+		x = T(static_cast<unsigned long long>(generator()));
+	return result;
+}
+
+// An NTT prime is transformed in its own field, any other modulus through CRT over enough primes
+static void TestNttMatchesSchoolbook() {
+	using Friendly = ModInt<998244353>;
+	using Wide = ModInt<(1ULL << 61) - 1>;
+	assert(NttRootOfUnity<998244353>().first == 23);
+	assert(NttRootOfUnity<(1ULL << 61) - 1>().first == 1);
+
+	for (size_t n : { 128, 300, 1000 }) {
+		for (size_t m : { 128, 777 }) {
+			const std::vector<Friendly> a = RandomModInts<Friendly>(n), b = RandomModInts<Friendly>(m);
+			std::vector<Friendly> direct;
+			assert(PolyMultiplyNttDirect(a, b, direct));
+			assert(direct == Schoolbook(a, b));
+			assert(PolyMultiply(a, b) == direct);
+
+			const std::vector<Wide> c = RandomModInts<Wide>(n), d = RandomModInts<Wide>(m);
+			std::vector<Wide> crt;
+			assert(!PolyMultiplyNttDirect(c, d, crt));
+			assert(PolyMultiplyNtt(c, d, crt));
+			assert(crt == Schoolbook(c, d));
+		}
+	}
+
+	// Every coefficient P - 1, the largest products the primes have to cover
+	const std::vector<Wide> top(4096, Wide(-1));
+	const std::vector<Wide> square = PolyMultiply(top, top);
+	for (size_t i = 0; i < square.size(); ++i)
+		assert(square[i] == Wide(static_cast<unsigned long long>(std::min(i + 1, square.size() - i))));
+
+	std::vector<long long> e(500), f(600);
+	for (auto& x : e)
+		x = static_cast<long long>(generator() % 2000001) - 1000000;
+	for (auto& x : f)
+		x = static_cast<long long>(generator() % 2000001) - 1000000;
+	assert(PolyMultiply(e, f) == Schoolbook(e, f));
+}
+
+// Karatsuba splits unequal and odd lengths correctly
+static void TestKaratsubaMatchesSchoolbook() {
+	for (size_t n : { 1, 64, 65, 301 }) {
+		for (size_t m : { 1, 100, 513 }) {
+			std::vector<long long> a(n), b(m);
+			for (auto& x : a)
+				x = static_cast<long long>(generator() % 2001) - 1000;
+			for (auto& x : b)
+				x = static_cast<long long>(generator() % 2001) - 1000;
+			assert(PolyMultiplyKaratsuba(a, b) == Schoolbook(a, b));
+		}
+	}
+}
+
+// Few terms over a high degree stay sparse, filling up turns dense, the value does not depend on the form
+static void TestDenseSparseSwitching() {
+	using P = Poly<long long>;
+	const P sparse(std::vector<std::pair<int, long long>>{ { 0, 1 }, { 1000, 2 }, { 5000, -1 } });
+	assert(sparse.IsSparse());
+	assert(sparse.Degree() == 5000 && sparse[1000] == 2 && sparse[999] == 0);
+
+	std::vector<long long> coefficients(5001, 0);
+	coefficients[0] = 1;
+	coefficients[1000] = 2;
+	coefficients[5000] = -1;
+	assert(P(coefficients) == sparse);
+
+	const P dense(std::vector<long long>{ 1, 2, 3, 4, 5, 6 });
+	assert(!dense.IsSparse());
+	const P product = sparse * dense;
+	const auto d = [&](int i) { return (i < 0 ? 0LL : dense[i]); };
+	for (int i : { 0, 5, 1000, 1003, 5005 })
+		assert(product[i] == sparse[0] * d(i) + sparse[1000] * d(i - 1000) + sparse[5000] * d(i - 5000));
+	assert(product(1) == sparse(1) * dense(1));
+	assert((sparse - sparse).IsZero());
+}
+
+// Multipoint evaluation through the subproduct tree agrees with Horner, interpolation inverts it
+static void TestEvaluationInterpolation() {
+	using M = ModInt<998244353>;
+	for (size_t n : { 10, 200, 1000 }) {
+		const Poly<M> p(RandomModInts<M>(n));
+		std::vector<M> points(n);
+		for (size_t i = 0; i < n; ++i)
+			points[i] = M(static_cast<unsigned long long>(3 * i + 1));
+
+		const std::vector<M> values = p.Evaluate(points);
+		for (size_t i = 0; i < n; i += 37)
+			assert(values[i] == p(points[i]));
+		assert(Poly<M>::Interpolate(points, values) == p);
+	}
+
+	// Lagrange over the rationals, including a degree below the number of points
+	const std::vector<Rational> points{ 0, 1, -1, 2, Rational(1, 2) };
+	const Poly<Rational> q(std::vector<Rational>{ Rational(1, 3), 0, -2, 1 });
+	assert(Poly<Rational>::Interpolate(points, q.Evaluate(points)) == q);
+}
+
+int main() {
+	TestNttMatchesSchoolbook();
+	TestKaratsubaMatchesSchoolbook();
+	TestDenseSparseSwitching();
+	TestEvaluationInterpolation();
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,161 @@
+// Build from the repository root with the sources on the include path, e.g.
+// g++ -std=c++17 -I. tests/regression_tests.cpp *.cpp -pthread
+
+#include "binary_format.h"
+#include "linal.h"
+#include "matrix.h"
+#include "rational.h"
+
+#include <cassert>
+#include <climits>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Poly has Euclidean division but is not a field: Det and CharacteristicPoly must stay division-free
+static void TestPolyMatrixDet() {
+	using P = Poly<long long>;
+	Matrix<P> a(2, 2);
+	a[0][0] = P(std::vector<long long>{ 1, 1 });
+	a[0][1] = P(2);
+	a[1][0] = P(3);
+	a[1][1] = P(std::vector<long long>{ 0, 1 });
+
+	// (t + 1) t - 6
+	assert(a.Det() == P(std::vector<long long>{ -6, 1, 1 }));
+
+	// s^2 - (2t + 1) s + t^2 + t - 6
+	const Poly<P> charpoly = a.CharacteristicPoly();
+	assert(charpoly.Degree() == 2);
+	assert(charpoly[2] == P(1));
+	assert(charpoly[1] == P(std::vector<long long>{ -1, -2 }));
+	assert(charpoly[0] == a.Det());
+}
+
+// 1 / pivot truncates to 0 for integers, Rank must not normalize pivot rows
+static void TestIntegerRank() {
+	Matrix<long long> a(2, 2);
+	a[0][0] = 2;
+	a[1][1] = 2;
+	assert(Rank(a) == 2);
+
+	Matrix<long long> b(3, 3);
+	const long long values[3][3] = { { 2, 4, 6 }, { 3, 5, 7 }, { 5, 9, 13 } };
+	for (size_t i = 0; i < 3; ++i)
+		for (size_t j = 0; j < 3; ++j)
+			b[i][j] = values[i][j];
+	assert(Rank(b) == 2);
+}
+
+// Sparse elimination of integers must stay fraction-free, like the dense KerBasis
+static void TestIntegerSparseKernel() {
+	const SparseMatrix<long long> a(1, 2, { { 0, 0, 2 }, { 0, 1, 1 } });
+	const Basis<long long> kernel = KerBasis(a);
+	assert(kernel.size() == 1);
+	assert(kernel[0][0][0] == -1 && kernel[0][1][0] == 2);
+
+	const SparseMatrix<long long> b(3, 4, { { 0, 0, 2 }, { 0, 1, 3 }, { 1, 1, 4 }, { 1, 2, 6 }, { 2, 0, 2 }, { 2, 1, 7 }, { 2, 2, 6 }, { 2, 3, 5 } });
+	assert(Rank(b) == 3);
+	const Basis<long long> kernelB = KerBasis(b);
+	assert(kernelB.size() == 1);
+	for (size_t i = 0; i < b.Height(); ++i) {
+		long long sum = 0;
+		for (size_t p = b.RowStarts()[i]; p < b.RowStarts()[i + 1]; ++p)
+			sum += b.Values()[p] * kernelB[0][b.Columns()[p]][0];
+		assert(sum == 0);
+	}
+}
+
+// LLONG_MIN and unsigned values above LLONG_MAX go to BigInteger, so negating them cannot overflow
+static void TestRationalLimits() {
+	const Rational minimum(LLONG_MIN);
+	std::ostringstream text;
+	text << -minimum << ' ' << minimum << ' ' << Rational(ULLONG_MAX) << ' ' << Rational(LLONG_MIN, -2LL);
+	assert(text.str() == "9223372036854775808 -9223372036854775808 18446744073709551615 4611686018427387904");
+
+	assert(-minimum == Rational(LLONG_MAX) + 1);
+	assert(-(-minimum) == minimum);
+	assert(minimum + 1 == Rational(LLONG_MIN + 1));
+	assert(std::abs(minimum) > LLONG_MAX);
+}
+
+// Negative exponents are negated without overflow, a singular base throws domain_error
+static void TestNegativePowers() {
+	// Cyclic shift of order 3: 2^63 = 2 mod 3, so A^LLONG_MIN = (A^-1)^2 = A
+	Matrix<double> a(3, 3);
+	a[0][1] = a[1][2] = a[2][0] = 1;
+	const Matrix<double> a2 = a * a;
+	assert((a ^ LLONG_MIN) == a);
+	assert((a ^ -1) == a2);
+	assert(a.PowerCayleyHamilton(LLONG_MIN) == a);
+	assert(a.PowerCayleyHamilton(-4) == a2);
+
+	Matrix<double> v(3, 1);
+	v[0][0] = 1;
+	v[1][0] = 2;
+	v[2][0] = 3;
+	assert(a.PowerTimes(LLONG_MIN, v) == a * v);
+
+	Matrix<double> singular(2, 2, 1);
+	bool thrown = false;
+	try {
+		singular ^ -1;
+	}
+	catch (const std::domain_error&) {
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+static bool ReadBinaryMatrixFails(const std::string& bytes) {
+	std::istringstream in(bytes);
+	try {
+		ReadBinaryMatrix<int>(in);
+	}
+	catch (const std::runtime_error&) {
+		return true;
+	}
+	return false;
+}
+
+// Header dimensions must agree with the payload before anything is allocated or read
+static void TestCorruptBinaryHeader() {
+	Matrix<int> a(2, 3, 7);
+	std::ostringstream out;
+	WriteBinary(out, a);
+	const std::string bytes = out.str();
+	{
+		std::istringstream in(bytes);
+		assert(ReadBinaryMatrix<int>(in) == a);
+	}
+
+	const auto withHeader = [&](uint64_t height, uint64_t width, uint64_t payloadSize, size_t keep) {
+		std::string corrupt = bytes.substr(0, keep);
+		BinaryHeader header;
+		std::memcpy(&header, corrupt.data(), sizeof(header));
+		header.height = height;
+		header.width = width;
+		header.payloadSize = payloadSize;
+		std::memcpy(&corrupt[0], &header, sizeof(header));
+		return corrupt;
+	};
+	assert(ReadBinaryMatrixFails(withHeader(uint64_t{ 1 } << 40, 3, 24, bytes.size())));
+	assert(ReadBinaryMatrixFails(withHeader(uint64_t{ 1 } << 40, 3, uint64_t{ 12 } << 40, bytes.size())));
+	// 2^62 * 4 elements of 4 bytes wrap around to a payload of 0 bytes without the overflow check
+	assert(ReadBinaryMatrixFails(withHeader(uint64_t{ 1 } << 62, 4, 0, sizeof(BinaryHeader))));
+	assert(ReadBinaryMatrixFails(withHeader(2, 3, 24, bytes.size() - 4)));
+}
+
+int main() {
+	TestPolyMatrixDet();
+	TestIntegerRank();
+	TestIntegerSparseKernel();
+	TestRationalLimits();
+	TestNegativePowers();
+	TestCorruptBinaryHeader();
+
+	std::cout << "ok" << std::endl;
+	return 0;
+}
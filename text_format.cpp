@@ -0,0 +1,55 @@
+#include "text_format.h"
+#include <string>
+using namespace std;
+
+TextParseError::TextParseError(const string& message, size_t line, size_t column)
+	: runtime_error("line " + to_string(line) + ", column " + to_string(column) + ": " + message), line(line), column(column) {}
+
+TextReader::TextReader(istream& in) : in(in), buffer(in.rdbuf()), line(1), column(1), tokenLine(1), tokenColumn(1) {}
+
+static bool IsSeparator(int c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f' || c == '|';
+}
+
+string_view TextReader::NextToken() {
+	token.clear();
+	if (!buffer) {
+		return token;
+	}
+
+	int c = buffer->sgetc();
+	while (c != char_traits<char>::eof() && IsSeparator(c)) {
+		if (c == '\n') {
+			++line;
+			column = 1;
+		}
+		else {
+			++column;
+		}
+		c = buffer->snextc();
+	}
+
+	tokenLine = line;
+	tokenColumn = column;
+	while (c != char_traits<char>::eof() && !IsSeparator(c)) {
+		token.push_back(static_cast<char>(c));
+		++column;
+		c = buffer->snextc();
+	}
+
+	if (c == char_traits<char>::eof()) {
+		in.setstate(ios::eofbit);
+	}
+
+	return token;
+}
+
+void TextReader::Fail(const string& message) const {
+	// The position is the useful part, so a failure thrown by the exception mask does not replace it
+	try {
+		in.setstate(ios::failbit);
+	}
+	catch (const ios_base::failure&) {
+	}
+	throw TextParseError(message, tokenLine, tokenColumn);
+}
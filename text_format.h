@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+class TextParseError : public std::runtime_error {
+public:
+	TextParseError(const std::string& message, size_t line, size_t column);
+
+	size_t Line() const {
+		return line;
+	}
+	size_t Column() const {
+		return column;
+	}
+
+private:
+	size_t line, column;
+};
+
+// Splits a stream into tokens separated by whitespace or '|', so that printed matrices can be read back.
+// Characters are taken straight from the stream buffer, which reads the input in chunks, and nothing after
+// the last token is consumed, so the stream can be used further.
+class TextReader {
+public:
+	explicit TextReader(std::istream& in);
+
+	// Empty at the end of the input, valid until the next call
+	std::string_view NextToken();
+
+	// Where the last token starts, counting from 1
+	size_t Line() const {
+		return tokenLine;
+	}
+	size_t Column() const {
+		return tokenColumn;
+	}
+
+	[[noreturn]] void Fail(const std::string& message) const;
+
+private:
+	std::istream& in;
+	std::streambuf* buffer;
+	std::string token;
+	size_t line, column, tokenLine, tokenColumn;
+};
+
+// Customization point found by argument-dependent lookup, like AppendText below: types with their own
+// textual form (Rational) overload it next to their definition. By default types constructible from an
+// integer (ModInt) accept integers and anything else is read with its operator>>.
+template<typename T>
+bool ParseText(std::string_view token, T& x) {
+	if constexpr (std::is_constructible<T, long long>::value) {
+		const char* first = token.data() + (!token.empty() && token.front() == '+');
+		const char* last = token.data() + token.size();
+		long long a = 0;
+		const auto [end, error] = std::from_chars(first, last, a);
+		if (error != std::errc() || end != last) {
+			return false;
+		}
+
+		x = T(a);
+		return true;
+	}
+	else {
+		std::istringstream stream{ std::string(token) };
+		return static_cast<bool>(stream >> x) && (stream >> std::ws).eof();
+	}
+}
+
+// Integers and floating point go straight through std::from_chars
+template<typename T>
+bool ParseElement(std::string_view token, T& x) {
+	if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value) {
+		const char* first = token.data() + (!token.empty() && token.front() == '+');
+		const char* last = token.data() + token.size();
+		const auto [end, error] = std::from_chars(first, last, x);
+		return error == std::errc() && end == last;
+	}
+	else {
+		return ParseText(token, x);
+	}
+}
+
+// Reads "height width" followed by the elements row by row, one row at a time, so that a huge
+// matrix never has to be held as text
+template<typename T>
+class MatrixTextReader {
+public:
+	explicit MatrixTextReader(std::istream& in) : reader(in), row(0) {
+		height = ReadSize();
+		width = ReadSize();
+	}
+
+	size_t Height() const {
+		return height;
+	}
+	size_t Width() const {
+		return width;
+	}
+
+	// Fills Width() elements, false once every row has been read
+	bool NextRow(T* elements) {
+		if (row == height) {
+			return false;
+		}
+
+		for (size_t j = 0; j < width; ++j) {
+			const std::string_view token = reader.NextToken();
+			if (token.empty()) {
+				reader.Fail("row " + std::to_string(row + 1) + " ends after " + std::to_string(j) + " of " + std::to_string(width) + " elements");
+			}
+			if (!ParseElement(token, elements[j])) {
+				reader.Fail("'" + std::string(token) + "' is not a valid element");
+			}
+		}
+		++row;
+
+		return true;
+	}
+
+private:
+	TextReader reader;
+	size_t height, width, row;
+
+	size_t ReadSize() {
+		const std::string_view token = reader.NextToken();
+		size_t size = 0;
+		const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), size);
+		if (token.empty() || error != std::errc() || end != token.data() + token.size()) {
+			reader.Fail("expected a matrix size, got '" + std::string(token) + "'");
+		}
+
+		return size;
+	}
+};
+
+// Customization point found by argument-dependent lookup, types with a faster way to print themselves
+// (Rational, ModInt) overload it next to their definition
+template<typename T>
+void AppendText(std::string& out, const T& x) {
+	thread_local std::ostringstream stream;
+	stream.str(std::string());
+	stream << x;
+	out += stream.str();
+}
+
+// Floating point follows the precision and the fixed / scientific / hexfloat flags of the target stream,
+// like operator<< does
+template<typename T>
+void AppendElement(std::string& out, const T& x, const std::ios_base& format) {
+	if constexpr (std::is_floating_point<T>::value) {
+		char digits[128];
+		const int precision = static_cast<int>(format.precision());
+		const std::ios_base::fmtflags field = format.flags() & std::ios_base::floatfield;
+		const bool hex = (field == (std::ios_base::fixed | std::ios_base::scientific));
+		std::to_chars_result result;
+		switch (field) {
+		case std::ios_base::fixed:
+			result = std::to_chars(digits, digits + sizeof(digits), x, std::chars_format::fixed, precision);
+			break;
+		case std::ios_base::scientific:
+			result = std::to_chars(digits, digits + sizeof(digits), x, std::chars_format::scientific, precision);
+			break;
+		case std::ios_base::fixed | std::ios_base::scientific:
+			result = std::to_chars(digits, digits + sizeof(digits), std::abs(x), std::chars_format::hex);
+			break;
+		default:
+			result = std::to_chars(digits, digits + sizeof(digits), x, std::chars_format::general, precision);
+		}
+
+		// Fixed notation of large values does not fit, the stream formats those
+		if (result.ec != std::errc()) {
+			thread_local std::ostringstream stream;
+			stream.str(std::string());
+			stream.flags(format.flags());
+			stream.precision(format.precision());
+			stream << x;
+			out += stream.str();
+			return;
+		}
+		// std::chars_format::hex leaves out the 0x that operator<< writes
+		if (hex) {
+			out += (std::signbit(x) ? "-" : "");
+			out += (std::isfinite(x) ? "0x" : "");
+		}
+		out.append(digits, result.ptr);
+	}
+	else if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value) {
+		char digits[64];
+		const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), x);
+		out.append(digits, result.ptr);
+	}
+	else {
+		AppendText(out, x);
+	}
+}
+
+// Rows above this many characters are not kept in the cached buffers between calls
+constexpr size_t TextCacheLimit = 1 << 20;
+
+// The aligned "|a  b|" layout: every element is formatted once into a cached buffer, column widths are
+// taken from the lengths in it, then rows are written in bulk. Works with anything that has Height(),
+// Width() and m[i][j].
+template<typename M>
+void WriteMatrixTable(std::ostream& out, const M& m) {
+	thread_local std::string text, line;
+	thread_local std::vector<size_t> ends;
+	text.clear();
+	ends.clear();
+
+	const size_t height = m.Height(), width = m.Width();
+	for (size_t i = 0; i < height; ++i) {
+		for (size_t j = 0; j < width; ++j) {
+			AppendElement(text, m[i][j], out);
+			ends.push_back(text.size());
+		}
+	}
+
+	std::vector<size_t> widths(width, 0);
+	for (size_t k = 0; k < ends.size(); ++k) {
+		widths[k % width] = std::max(widths[k % width], ends[k] - (k ? ends[k - 1] : 0));
+	}
+
+	for (size_t i = 0, k = 0; i < height; ++i) {
+		line.clear();
+		line += '|';
+		for (size_t j = 0; j < width; ++j, ++k) {
+			const size_t begin = (k ? ends[k - 1] : 0);
+			line.append(widths[j] + (j != 0) - (ends[k] - begin), ' ');
+			line.append(text, begin, ends[k] - begin);
+		}
+		line += '|';
+		if (i + 1 < height) {
+			line += '\n';
+		}
+		out.write(line.data(), static_cast<std::streamsize>(line.size()));
+	}
+
+	if (text.capacity() > TextCacheLimit) {
+		std::string().swap(text);
+		std::vector<size_t>().swap(ends);
+	}
+	if (line.capacity() > TextCacheLimit) {
+		std::string().swap(line);
+	}
+}
+
+// Streaming layout read back by MatrixTextReader: "height width", then one row per line. Each row is
+// formatted and written on its own, so memory does not grow with the matrix.
+template<typename M>
+void WriteMatrixText(std::ostream& out, const M& m) {
+	thread_local std::string line;
+	line.clear();
+	AppendElement(line, m.Height(), out);
+	line += ' ';
+	AppendElement(line, m.Width(), out);
+	line += '\n';
+	out.write(line.data(), static_cast<std::streamsize>(line.size()));
+
+	for (size_t i = 0; i < m.Height(); ++i) {
+		line.clear();
+		for (size_t j = 0; j < m.Width(); ++j) {
+			if (j != 0) {
+				line += ' ';
+			}
+			AppendElement(line, m[i][j], out);
+		}
+		line += '\n';
+		out.write(line.data(), static_cast<std::streamsize>(line.size()));
+	}
+
+	if (line.capacity() > TextCacheLimit) {
+		std::string().swap(line);
+	}
+}
@@ -0,0 +1,166 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace
+{
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local size_t currentQueue = 0;
+
+	std::unique_ptr<ThreadPool>& GlobalPool()
+	{
+		static std::unique_ptr<ThreadPool> pool = std::make_unique<ThreadPool>();
+		return pool;
+	}
+}
+
+ThreadPool::ThreadPool(size_t threadCount) : threadCount(threadCount), pending(0), stop(false)
+{
+	if (this->threadCount == 0)
+		this->threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (size_t i = 0; i < this->threadCount; ++i)
+		queues.push_back(std::make_unique<Queue>());
+
+	// Queue 0 belongs to the outside threads, the workers own the rest
+	for (size_t i = 1; i < this->threadCount; ++i)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for (auto& i : workers)
+		i.join();
+}
+
+size_t ThreadPool::ThreadCount() const
+{
+	return threadCount;
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+	if (begin >= end)
+		return;
+
+	grain = std::max<size_t>(grain, 1);
+	size_t chunks = std::min((end - begin + grain - 1) / grain, 4 * threadCount);
+	if (chunks <= 1 || threadCount == 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	std::atomic<size_t> remaining(chunks);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	const size_t self = CurrentQueue();
+	for (size_t c = 0; c < chunks; ++c)
+	{
+		size_t lo = begin + (end - begin) * c / chunks, hi = begin + (end - begin) * (c + 1) / chunks;
+		Push((self + c) % threadCount, [&, lo, hi]() {
+			try
+			{
+				body(lo, hi);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error)
+					error = std::current_exception();
+			}
+			remaining.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	while (remaining.load(std::memory_order_acquire) > 0)
+		if (!RunOne(self))
+			std::this_thread::yield();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+ThreadPool& ThreadPool::Global()
+{
+	return *GlobalPool();
+}
+
+void ThreadPool::SetGlobalThreadCount(size_t threadCount)
+{
+	GlobalPool() = std::make_unique<ThreadPool>(threadCount);
+}
+
+size_t ThreadPool::CurrentQueue() const
+{
+	return (currentPool == this ? currentQueue : 0);
+}
+
+void ThreadPool::Push(size_t queue, std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+		queues[queue]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		++pending;
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::RunOne(size_t self)
+{
+	std::function<void()> task;
+	for (size_t i = 0; i < threadCount && !task; ++i)
+	{
+		Queue& queue = *queues[(self + i) % threadCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		// Own work is taken LIFO for locality, stolen work FIFO so that the biggest leftovers move
+		if (i == 0)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (!task)
+		return false;
+
+	--pending;
+	task();
+	return true;
+}
+
+void ThreadPool::WorkerLoop(size_t self)
+{
+	currentPool = this;
+	currentQueue = self;
+
+	while (true)
+	{
+		if (RunOne(self))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this]() { return stop || pending > 0; });
+		if (stop)
+			return;
+	}
+}
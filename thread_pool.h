@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool: every thread owns a deque, takes work from its back and steals from the front of the others.
+// The thread that calls ParallelFor works on its own job too, so nested calls do not deadlock.
+class ThreadPool
+{
+public:
+	// 0 means std::thread::hardware_concurrency(), 1 means everything runs on the calling thread
+	explicit ThreadPool(size_t threadCount = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	size_t ThreadCount() const;
+
+	// Calls body(lo, hi) on disjoint subranges of [begin, end), each at least grain long (except the last one).
+	// Returns when all of them are done, rethrows the first exception thrown by body.
+	void ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+	static ThreadPool& Global();
+	// Must not be called while the global pool is running something
+	static void SetGlobalThreadCount(size_t threadCount);
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	size_t threadCount;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+
+	std::atomic<size_t> pending;
+	bool stop;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	size_t CurrentQueue() const;
+	void Push(size_t queue, std::function<void()> task);
+	bool RunOne(size_t self);
+	void WorkerLoop(size_t self);
+};
+
+template<typename F>
+void ParallelFor(size_t begin, size_t end, size_t grain, F&& body)
+{
+	if (end - begin <= grain || ThreadPool::Global().ThreadCount() == 1)
+	{
+		if (begin < end)
+			body(begin, end);
+		return;
+	}
+
+	ThreadPool::Global().ParallelFor(begin, end, grain, body);
+}